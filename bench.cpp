@@ -0,0 +1,205 @@
+/*
+ * Benchmark sweep of the vector add, written as JSON for perf_compare.py.
+ *
+ *   bench [-r repeats] [-o file.json]      (default bench.json)
+ *
+ * For each size in the sweep it times, repeats times:
+ *   reference  the plain host loop the examples verify against
+ *   htod       copying a and b to the device (pinned host memory)
+ *   kernel     launching Sum and waiting for it
+ *   dtoh       copying c back
+ *   total      the three device phases back to back
+ *
+ * Device cases are named after the backend that ran them ("cuda/..." or
+ * "cpu/..."), so one baseline file can hold the CPU backend numbers and the
+ * GPU numbers side by side; the comparator only pairs cases present in
+ * both files. `make perfcheck` runs the sweep and compares it with
+ * perf_baseline.json, `make perf-baseline` replaces the baseline.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <cuda.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "cuda_helper.h"
+
+#define REPEATS 15
+
+static const int sizes[] = { 1 << 10, 1 << 14, 1 << 18, 1 << 20, 1 << 22 };
+
+struct Case {
+    std::string         name;
+    int                 n;
+    std::vector<double> samples;    // ms per run
+};
+
+// --- functions -----------------------------------------------------------
+void runKernel(CUdeviceptr d_a, CUdeviceptr d_b, CUdeviceptr d_c, int n)
+{
+    void *args[] = { &d_a, &d_b, &d_c ,&n};
+    int block_size;
+    checkCudaErrors(drv.cuDeviceGetAttribute(&block_size, CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_X, device));
+
+    checkCudaErrors( drv.cuLaunchKernel(function,
+                                    (n+block_size-1)/block_size, 1, 1,  // Grid dim
+                                    block_size, 1, 1,                   // Threads dim
+                                    0, 0, args, 0) );
+}
+
+// Keeps the compiler from dropping the reference loop.
+volatile int sink;
+
+double referenceAdd(const int *a, const int *b, int *c, int n)
+{
+    startup_clock::time_point t0 = startup_clock::now();
+    for (int i = 0; i < n; ++i)
+        c[i] = a[i] + b[i];
+    sink = c[n - 1];
+    return elapsedMs(t0);
+}
+
+void sweep(int n, int repeats, std::vector<Case> &cases)
+{
+    const char *prefix = (backend == BACKEND_CUDA) ? "cuda" : "cpu";
+    size_t bytes = sizeof(int) * n;
+    int *a, *b, *c;
+    CUdeviceptr d_a, d_b, d_c;
+
+    checkCudaErrors( allocPinned((void**)&a, bytes, "bench") );
+    checkCudaErrors( allocPinned((void**)&b, bytes, "bench") );
+    checkCudaErrors( allocPinned((void**)&c, bytes, "bench") );
+    checkCudaErrors( allocDevice(&d_a, bytes, "bench") );
+    checkCudaErrors( allocDevice(&d_b, bytes, "bench") );
+    checkCudaErrors( allocDevice(&d_c, bytes, "bench") );
+    for (int i = 0; i < n; ++i) {
+        a[i] = inputA(i, n);
+        b[i] = inputB(i);
+    }
+
+    Case reference = { "reference", n, std::vector<double>() };
+    Case htod   = { std::string(prefix) + "/htod", n, std::vector<double>() };
+    Case kernel = { std::string(prefix) + "/kernel", n, std::vector<double>() };
+    Case dtoh   = { std::string(prefix) + "/dtoh", n, std::vector<double>() };
+    Case total  = { std::string(prefix) + "/total", n, std::vector<double>() };
+
+    // the first round warms caches and the driver; it is not recorded
+    for (int r = -1; r < repeats; ++r) {
+        double ref = referenceAdd(a, b, c, n);
+
+        startup_clock::time_point t0 = startup_clock::now();
+        checkCudaErrors( drv.cuMemcpyHtoD(d_a, a, bytes) );
+        checkCudaErrors( drv.cuMemcpyHtoD(d_b, b, bytes) );
+        double tHtoD = elapsedMs(t0);
+
+        startup_clock::time_point t1 = startup_clock::now();
+        runKernel(d_a, d_b, d_c, n);
+        checkCudaErrors( drv.cuStreamSynchronize(0) );
+        double tKernel = elapsedMs(t1);
+
+        startup_clock::time_point t2 = startup_clock::now();
+        checkCudaErrors( drv.cuMemcpyDtoH(c, d_c, bytes) );
+        double tDtoH = elapsedMs(t2);
+
+        if (r < 0)
+            continue;
+        reference.samples.push_back(ref);
+        htod.samples.push_back(tHtoD);
+        kernel.samples.push_back(tKernel);
+        dtoh.samples.push_back(tDtoH);
+        total.samples.push_back(elapsedMs(t0));
+    }
+
+    for (int i = 0; i < n; ++i) {
+        if (c[i] != a[i] + b[i]) {
+            printf("* Error at array position %d: Expected %d, Got %d\n", i, a[i]+b[i], c[i]);
+            exit(-1);
+        }
+    }
+
+    cases.push_back(reference);
+    cases.push_back(htod);
+    cases.push_back(kernel);
+    cases.push_back(dtoh);
+    cases.push_back(total);
+
+    checkCudaErrors( freeDevice(d_a) );
+    checkCudaErrors( freeDevice(d_b) );
+    checkCudaErrors( freeDevice(d_c) );
+    checkCudaErrors( freePinned(a) );
+    checkCudaErrors( freePinned(b) );
+    checkCudaErrors( freePinned(c) );
+}
+
+void writeJson(FILE *out, const std::vector<Case> &cases, int repeats)
+{
+    fprintf(out, "{\n  \"backend\": \"%s\",\n  \"repeats\": %d,\n  \"cases\": [\n",
+            (backend == BACKEND_CUDA) ? "cuda" : "cpu", repeats);
+    for (size_t i = 0; i < cases.size(); ++i) {
+        const Case &k = cases[i];
+        fprintf(out, "    { \"name\": \"%s/n=%d\", \"n\": %d, \"unit\": \"ms\", \"samples\": [",
+                k.name.c_str(), k.n, k.n);
+        for (size_t s = 0; s < k.samples.size(); ++s)
+            fprintf(out, "%s%.6f", s ? ", " : "", k.samples[s]);
+        fprintf(out, "] }%s\n", (i + 1 < cases.size()) ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    int repeats = REPEATS;
+    const char *output = "bench.json";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:o:")) != -1) {
+        if (opt == 'r') {
+            repeats = atoi(optarg);
+        } else if (opt == 'o') {
+            output = optarg;
+        } else {
+            fprintf(stderr, "usage: %s [-r repeats] [-o file.json]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (repeats < 1) {
+        fprintf(stderr, "Error: repeats must be positive\n");
+        return -1;
+    }
+
+    printf("- Initializing...\n");
+    initCUDA();
+
+    std::vector<Case> cases;
+    printf("# Running the sweep (%d repeats)...\n", repeats);
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        size_t first = cases.size();
+        sweep(sizes[i], repeats, cases);
+        printf("  n=%-9d", sizes[i]);
+        for (size_t k = first; k < cases.size(); ++k) {
+            std::vector<double> s = cases[k].samples;
+            std::sort(s.begin(), s.end());
+            size_t slash = cases[k].name.find('/');
+            std::string phase = (slash == std::string::npos) ? cases[k].name : cases[k].name.substr(slash + 1);
+            printf(" %s %.3f", phase.c_str(), s[s.size() / 2]);
+        }
+        printf(" (median ms)\n");
+    }
+
+    FILE *out = fopen(output, "w");
+    if (!out) {
+        fprintf(stderr, "Error: cannot write %s\n", output);
+        return -1;
+    }
+    writeJson(out, cases, repeats);
+    fclose(out);
+    printf("> Samples written to %s\n", output);
+
+    printf("- Finalizing...\n");
+    finalizeCUDA();
+    return 0;
+}
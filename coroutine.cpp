@@ -0,0 +1,99 @@
+/*
+ * Many vector additions in flight on one host thread, written as C++20
+ * coroutines over the driver API.
+ *
+ * Ref:
+ * https://docs.nvidia.com/cuda/cuda-driver-api
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cuda.h>
+
+#include "cuda_handles.h"
+#include "cuda_coro.h"
+
+#define N       10000
+#define SMALL_N 100         // size of the interactive jobs
+#define JOBS    256
+#define STREAMS 4           // per priority class
+
+// --- functions -----------------------------------------------------------
+Job vectorAddJob(Reactor &reactor, CUstream stream, int id, int n, int block_size, int *failures)
+{
+    // pinned host buffers, so that the copies are truly asynchronous; all
+    // six live in the coroutine frame and are freed when the job ends
+    PinnedBuffer<int> a, b, c;
+    DeviceBuffer<int> d_a, d_b, d_c;
+    checkCudaErrors( a.allocate(n, "staging", id) );
+    checkCudaErrors( b.allocate(n, "staging", id) );
+    checkCudaErrors( c.allocate(n, "staging", id) );
+    checkCudaErrors( d_a.allocate(n, "input", id) );
+    checkCudaErrors( d_b.allocate(n, "input", id) );
+    checkCudaErrors( d_c.allocate(n, "output", id) );
+
+    for (int i = 0; i < n; ++i) {
+        a[i] = n - i + id;
+        b[i] = i * i;
+    }
+
+    CUdeviceptr pa = d_a.get(), pb = d_b.get(), pc = d_c.get();
+    void *args[] = { &pa, &pb, &pc, &n };
+    checkCudaErrors( co_await copy_to_device(reactor, stream, d_a.span(), a.span()) );
+    checkCudaErrors( co_await copy_to_device(reactor, stream, d_b.span(), b.span()) );
+    checkCudaErrors( co_await launch(reactor, stream, function,
+                                     (n+block_size-1)/block_size, block_size, args) );
+    checkCudaErrors( co_await copy_to_host(reactor, stream, c.span(), d_c.span()) );
+
+    for (int i = 0; i < n; ++i) {
+        if (c[i] != a[i] + b[i]) {
+            printf("* Job %d: error at array position %d: Expected %d, Got %d\n",
+                   id, i, a[i]+b[i], c[i]);
+            ++*failures;
+            break;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Reactor  reactor;
+    Stream   streams[JOB_PRIORITIES][STREAMS];
+    int      block_size;
+    int      failures = 0;
+
+    // initialize
+    printf("- Initializing...\n");
+    initCUDA();
+    checkCudaErrors( drv.cuDeviceGetAttribute(&block_size, CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_X, device) );
+    for (int p = 0; p < JOB_PRIORITIES; ++p)
+        for (int s = 0; s < STREAMS; ++s)
+            checkCudaErrors( streams[p][s].acquire((JobPriority)p) );
+
+    // each job runs up to its first co_await and suspends; every fourth job
+    // is a small interactive one that should overtake the bulk work
+    printf("# Starting %d jobs on %d streams...\n", JOBS, JOB_PRIORITIES * STREAMS);
+    for (int j = 0; j < JOBS; ++j) {
+        JobPriority priority = (j % 4 == 0) ? JOB_INTERACTIVE : JOB_BULK;
+        vectorAddJob(reactor, streams[priority][j % STREAMS].get(), j,
+                     priority == JOB_INTERACTIVE ? SMALL_N : N, block_size, &failures);
+    }
+
+    // resume jobs as their stream work completes
+    reactor.run();
+    printf("# All jobs complete.\n");
+
+    if (failures == 0) {
+        printf("*** All checks complete.\n");
+    } else {
+        printf("*** %d jobs incorrect.\n", failures);
+    }
+
+    // finish
+    printf("- Finalizing...\n");
+    for (int p = 0; p < JOB_PRIORITIES; ++p)
+        for (int s = 0; s < STREAMS; ++s)
+            streams[p][s].reset();
+    finalizeCUDA();
+    return 0;
+}
@@ -0,0 +1,265 @@
+/*
+ * Offload cost model: predicts how long a vector add of n elements takes on
+ * the host and on the device, and routes each job to the faster one.
+ *
+ *   device(n) = 3 copyMs + launchMs + 8n / htod + 12n / device + 4n / dtoh
+ *   host(n)   = min(12n / host,  fanoutMs + 12n / pool)
+ *
+ * (bandwidths in GB/s; 8n and 4n bytes cross the link, the kernel and the
+ * host loop each touch 12n bytes). initCUDA() calibrates the parameters
+ * with a small and a large job on each side, which separates the fixed
+ * costs from the bandwidths. Every routed job then reports its timings
+ * back through observeHost()/observeDevice(): a phase dominated by its
+ * fixed cost refines that cost, a phase dominated by bandwidth refines the
+ * bandwidth, each as an exponentially weighted average.
+ *
+ * A job can also be split between the two (CoexecSplit): the device takes
+ * the first part of the range and the host pool the rest, sized so both
+ * finish at the same time.
+ */
+
+#ifndef COST_MODEL_H
+#define COST_MODEL_H
+
+#include <stdio.h>
+#include <algorithm>
+#include <mutex>
+
+// Weight of a new observation in the running averages.
+#define OFFLOAD_LEARNING_RATE 0.2
+
+struct OffloadParams {
+    double copyMs;          // fixed cost of one host <-> device copy
+    double launchMs;        // launch and synchronisation of a kernel
+    double htodGBs;
+    double dtohGBs;
+    double deviceGBs;       // kernel access to device memory
+    double hostGBs;         // host add, one thread
+    double poolGBs;         // host add, all pool threads
+    double fanoutMs;        // waking and joining the pool
+};
+
+enum OffloadRoute {
+    ROUTE_HOST,
+    ROUTE_DEVICE,
+    ROUTE_SPLIT             // both, see CoexecSplit
+};
+
+class OffloadModel {
+public:
+    OffloadModel()
+    {
+        OffloadParams none = { 0, 0, 1, 1, 1, 1, 1, 0 };
+        p = none;
+    }
+
+    void setParams(const OffloadParams &params)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        p = params;
+    }
+
+    OffloadParams params()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return p;
+    }
+
+    double predictHost(double n)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return host(n, NULL);
+    }
+
+    // Whether the pool is the faster way to run n on the host.
+    bool usePool(double n)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        bool pooled;
+        host(n, &pooled);
+        return pooled;
+    }
+
+    double predictDevice(double n)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return device(n);
+    }
+
+    OffloadRoute route(double n)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return host(n, NULL) <= device(n) ? ROUTE_HOST : ROUTE_DEVICE;
+    }
+
+    // Share of n to give the device so that it and the host pool, running
+    // side by side, finish together.
+    double balance(double n)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        double lo = 0, hi = 1;
+        for (int i = 0; i < 40; ++i) {
+            double mid = (lo + hi) / 2;
+            if (device(mid * n) < host((1 - mid) * n, NULL))
+                lo = mid;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
+    // Time of n split at share: the slower of the two sides.
+    double predictSplit(double n, double share)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::max(device(share * n), host((1 - share) * n, NULL));
+    }
+
+    // Largest n that still runs on the host (the curves cross once).
+    long long crossover()
+    {
+        long long lo = 0, hi = 1LL << 31;
+        while (lo + 1 < hi) {
+            long long mid = lo + (hi - lo) / 2;
+            if (route((double)mid) == ROUTE_HOST)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
+    void observeHost(double n, bool pooled, double ms)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        double none = 0;
+        if (pooled)
+            refine(&p.fanoutMs, &p.poolGBs, 12 * n, ms);
+        else
+            refine(&none, &p.hostGBs, 12 * n, ms);
+    }
+
+    // Per-phase times of one unchunked job; htodMs covers both input copies.
+    void observeDevice(double n, double htodMs, double kernelMs, double dtohMs)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        double copyIn = 2 * p.copyMs, copyOut = p.copyMs;
+        refine(&copyIn, &p.htodGBs, 8 * n, htodMs);
+        refine(&p.launchMs, &p.deviceGBs, 12 * n, kernelMs);
+        refine(&copyOut, &p.dtohGBs, 4 * n, dtohMs);
+        p.copyMs = (copyIn / 2 + copyOut) / 2;
+    }
+
+    void print()
+    {
+        OffloadParams q = params();
+        printf("> Offload model: copy %.1f us, launch %.1f us, htod %.1f GB/s, dtoh %.1f GB/s,\n"
+               "  device %.1f GB/s, host %.1f GB/s (pool %.1f GB/s, fan-out %.1f us)\n",
+               q.copyMs * 1e3, q.launchMs * 1e3, q.htodGBs, q.dtohGBs, q.deviceGBs,
+               q.hostGBs, q.poolGBs, q.fanoutMs * 1e3);
+    }
+
+private:
+    // mutex held
+    double host(double n, bool *pooled)
+    {
+        double single = 12 * n / (p.hostGBs * 1e6);
+        double pool = p.fanoutMs + 12 * n / (p.poolGBs * 1e6);
+        if (pooled)
+            *pooled = pool < single;
+        return pool < single ? pool : single;
+    }
+
+    double device(double n)
+    {
+        return 3 * p.copyMs + p.launchMs + 8 * n / (p.htodGBs * 1e6) +
+               12 * n / (p.deviceGBs * 1e6) + 4 * n / (p.dtohGBs * 1e6);
+    }
+
+    // A phase took ms for `bytes` after a fixed cost: refine whichever of
+    // the two explains most of the predicted time.
+    static void refine(double *fixed, double *gbs, double bytes, double ms)
+    {
+        double transfer = bytes / (*gbs * 1e6);
+        if (transfer >= *fixed) {
+            double rest = ms - *fixed;
+            if (rest > 0)
+                *gbs += OFFLOAD_LEARNING_RATE * (bytes / (rest * 1e6) - *gbs);
+        } else {
+            double rest = ms - transfer;
+            if (rest > 0)
+                *fixed += OFFLOAD_LEARNING_RATE * (rest - *fixed);
+        }
+    }
+
+    std::mutex    mutex;
+    OffloadParams p;
+};
+
+// Device share of a job split between the device and the host pool. The
+// first split comes from the model's balance point; after that each split
+// uses the rates the two sides achieved on the previous one, which already
+// include the contention between them that the model does not know about.
+class CoexecSplit {
+public:
+    CoexecSplit() : share(-1) {}
+
+    double deviceShare(OffloadModel &model, double n)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (share >= 0)
+                return share;
+        }
+        return model.balance(n);
+    }
+
+    // Elements and wall time of each side of one split job. A side that
+    // got no work says nothing about its rate, so the share is kept.
+    void observe(double deviceN, double deviceMs, double hostN, double hostMs)
+    {
+        if (deviceN <= 0 || hostN <= 0 || deviceMs <= 0 || hostMs <= 0)
+            return;
+        double dev = deviceN / deviceMs, host = hostN / hostMs;
+        std::lock_guard<std::mutex> lock(mutex);
+        share = dev / (dev + host);
+    }
+
+    // The share carries over between processes through a one-line file.
+    bool load(const char *path)
+    {
+        FILE *f = fopen(path, "r");
+        if (!f)
+            return false;
+        double s;
+        bool ok = fscanf(f, "%lf", &s) == 1 && s >= 0 && s <= 1;
+        fclose(f);
+        if (ok) {
+            std::lock_guard<std::mutex> lock(mutex);
+            share = s;
+        }
+        return ok;
+    }
+
+    bool save(const char *path)
+    {
+        double s;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            s = share;
+        }
+        if (s < 0)
+            return false;
+        FILE *f = fopen(path, "w");
+        if (!f)
+            return false;
+        fprintf(f, "%.6f\n", s);
+        return fclose(f) == 0;
+    }
+
+private:
+    std::mutex mutex;
+    double     share;           // < 0 until the first observation
+};
+
+#endif // COST_MODEL_H
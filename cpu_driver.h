@@ -0,0 +1,333 @@
+/*
+ * CPU stand-in for the driver entry points used by the examples.
+ *
+ * Device memory is ordinary host memory, streams run synchronously and
+ * kernels are looked up by name in hostKernels[]. Every function has the
+ * same signature as its driver counterpart so it can be installed in the
+ * driver function table (see cuda_driver.h).
+ */
+
+#ifndef CPU_DRIVER_H
+#define CPU_DRIVER_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <cuda.h>
+#include <chrono>
+#include <thread>
+
+#include "kernel_host.h"
+
+struct CUctx_st { CUdevice device; };
+
+static thread_local CUcontext cpuCurrentContext = NULL;
+
+// --- initialisation and devices ------------------------------------------
+inline CUresult cpuInit(unsigned int)
+{
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuDeviceGetCount(int *count)
+{
+    const char *simulated = getenv("VADD_CPU_DEVICES");
+    *count = (simulated && atoi(simulated) > 0) ? atoi(simulated) : 1;
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuDeviceGet(CUdevice *device, int ordinal)
+{
+    int count;
+    cpuDeviceGetCount(&count);
+    if (ordinal < 0 || ordinal >= count)
+        return CUDA_ERROR_INVALID_DEVICE;
+    *device = ordinal;
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuDeviceGetName(char *name, int len, CUdevice)
+{
+    strncpy(name, "CPU fallback", len);
+    name[len - 1] = '\0';
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuDeviceGetAttribute(int *pi, CUdevice_attribute attrib, CUdevice)
+{
+    switch (attrib) {
+    case CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_X:
+    case CU_DEVICE_ATTRIBUTE_MAX_THREADS_PER_BLOCK:
+        *pi = 1024;
+        break;
+    case CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT:
+        *pi = (int)std::thread::hardware_concurrency();
+        break;
+    case CU_DEVICE_ATTRIBUTE_UNIFIED_ADDRESSING:
+        *pi = 1;
+        break;
+    default:
+        *pi = 0;
+        break;
+    }
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuDeviceTotalMem(size_t *bytes, CUdevice)
+{
+    *bytes = (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGESIZE);
+    return CUDA_SUCCESS;
+}
+
+// All simulated devices share host memory.
+inline CUresult cpuDeviceCanAccessPeer(int *canAccessPeer, CUdevice dev, CUdevice peerDev)
+{
+    *canAccessPeer = (dev != peerDev);
+    return CUDA_SUCCESS;
+}
+
+// Simulated devices sit on no bus.
+inline CUresult cpuDeviceGetPCIBusId(char *, int, CUdevice)
+{
+    return CUDA_ERROR_NOT_SUPPORTED;
+}
+
+// --- contexts and modules ------------------------------------------------
+inline CUresult cpuCtxCreate(CUcontext *pctx, unsigned int, CUdevice dev)
+{
+    *pctx = new CUctx_st();
+    (*pctx)->device = dev;
+    cpuCurrentContext = *pctx;
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuCtxDestroy(CUcontext ctx)
+{
+    if (cpuCurrentContext == ctx)
+        cpuCurrentContext = NULL;
+    delete ctx;
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuCtxSetCurrent(CUcontext ctx)
+{
+    cpuCurrentContext = ctx;
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuCtxGetCurrent(CUcontext *pctx)
+{
+    *pctx = cpuCurrentContext;
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuCtxEnablePeerAccess(CUcontext, unsigned int)
+{
+    return CUDA_SUCCESS;
+}
+
+// Two levels, like the smallest range a device reports. Priorities have no
+// effect here since every stream runs to completion on submission.
+inline CUresult cpuCtxGetStreamPriorityRange(int *leastPriority, int *greatestPriority)
+{
+    if (leastPriority)
+        *leastPriority = 0;
+    if (greatestPriority)
+        *greatestPriority = -1;
+    return CUDA_SUCCESS;
+}
+
+// The kernels are compiled into the binary, so there is nothing to load.
+inline CUresult cpuModuleLoad(CUmodule *module, const char *)
+{
+    *module = (CUmodule)hostKernels;
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuModuleUnload(CUmodule)
+{
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuModuleGetFunction(CUfunction *hfunc, CUmodule, const char *name)
+{
+    const HostKernel *kernel = findHostKernel(name);
+    if (!kernel)
+        return CUDA_ERROR_NOT_FOUND;
+    *hfunc = (CUfunction)kernel;
+    return CUDA_SUCCESS;
+}
+
+// --- memory --------------------------------------------------------------
+inline CUresult cpuMemGetInfo(size_t *free, size_t *total)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    *free = (size_t)sysconf(_SC_AVPHYS_PAGES) * page;
+    *total = (size_t)sysconf(_SC_PHYS_PAGES) * page;
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuMemAlloc(CUdeviceptr *dptr, size_t bytesize)
+{
+    void *p = malloc(bytesize);
+    if (!p)
+        return CUDA_ERROR_OUT_OF_MEMORY;
+    *dptr = (CUdeviceptr)p;
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuMemFree(CUdeviceptr dptr)
+{
+    free((void*)dptr);
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuMemAllocHost(void **pp, size_t bytesize)
+{
+    *pp = malloc(bytesize);
+    return *pp ? CUDA_SUCCESS : CUDA_ERROR_OUT_OF_MEMORY;
+}
+
+inline CUresult cpuMemFreeHost(void *p)
+{
+    free(p);
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuMemcpyHtoD(CUdeviceptr dstDevice, const void *srcHost, size_t ByteCount)
+{
+    memcpy((void*)dstDevice, srcHost, ByteCount);
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuMemcpyDtoH(void *dstHost, CUdeviceptr srcDevice, size_t ByteCount)
+{
+    memcpy(dstHost, (const void*)srcDevice, ByteCount);
+    return CUDA_SUCCESS;
+}
+
+// Streams are executed in order on the calling thread, so the asynchronous
+// copies complete before they return.
+inline CUresult cpuMemcpyHtoDAsync(CUdeviceptr dstDevice, const void *srcHost, size_t ByteCount, CUstream)
+{
+    return cpuMemcpyHtoD(dstDevice, srcHost, ByteCount);
+}
+
+inline CUresult cpuMemcpyDtoHAsync(void *dstHost, CUdeviceptr srcDevice, size_t ByteCount, CUstream)
+{
+    return cpuMemcpyDtoH(dstHost, srcDevice, ByteCount);
+}
+
+inline CUresult cpuMemcpyPeerAsync(CUdeviceptr dstDevice, CUcontext, CUdeviceptr srcDevice, CUcontext,
+                                   size_t ByteCount, CUstream)
+{
+    memcpy((void*)dstDevice, (const void*)srcDevice, ByteCount);
+    return CUDA_SUCCESS;
+}
+
+// Device memory is private heap memory here, so it cannot be shared.
+inline CUresult cpuIpcGetMemHandle(CUipcMemHandle *, CUdeviceptr)
+{
+    return CUDA_ERROR_NOT_SUPPORTED;
+}
+
+inline CUresult cpuIpcOpenMemHandle(CUdeviceptr *, CUipcMemHandle, unsigned int)
+{
+    return CUDA_ERROR_NOT_SUPPORTED;
+}
+
+inline CUresult cpuIpcCloseMemHandle(CUdeviceptr)
+{
+    return CUDA_ERROR_NOT_SUPPORTED;
+}
+
+// --- execution -----------------------------------------------------------
+struct CUstream_st { unsigned int flags; int priority; };
+
+inline CUresult cpuStreamCreateWithPriority(CUstream *phStream, unsigned int flags, int priority)
+{
+    *phStream = new CUstream_st();
+    (*phStream)->flags = flags;
+    (*phStream)->priority = priority;
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuStreamCreate(CUstream *phStream, unsigned int Flags)
+{
+    return cpuStreamCreateWithPriority(phStream, Flags, 0);
+}
+
+inline CUresult cpuStreamDestroy(CUstream hStream)
+{
+    delete hStream;
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuStreamSynchronize(CUstream)
+{
+    return CUDA_SUCCESS;
+}
+
+// All earlier work on the stream has already completed.
+inline CUresult cpuLaunchHostFunc(CUstream, CUhostFn fn, void *userData)
+{
+    fn(userData);
+    return CUDA_SUCCESS;
+}
+
+// Work completes on submission, so an event records the time it was reached.
+struct CUevent_st {
+    unsigned int flags;
+    std::chrono::steady_clock::time_point recorded;
+};
+
+inline CUresult cpuEventCreate(CUevent *phEvent, unsigned int Flags)
+{
+    *phEvent = new CUevent_st();
+    (*phEvent)->flags = Flags;
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuEventDestroy(CUevent hEvent)
+{
+    delete hEvent;
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuEventRecord(CUevent hEvent, CUstream)
+{
+    hEvent->recorded = std::chrono::steady_clock::now();
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuEventQuery(CUevent)
+{
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuEventSynchronize(CUevent)
+{
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuEventElapsedTime(float *pMilliseconds, CUevent hStart, CUevent hEnd)
+{
+    if ((hStart->flags | hEnd->flags) & CU_EVENT_DISABLE_TIMING)
+        return CUDA_ERROR_INVALID_HANDLE;
+    *pMilliseconds = std::chrono::duration<float, std::milli>(hEnd->recorded - hStart->recorded).count();
+    return CUDA_SUCCESS;
+}
+
+inline CUresult cpuLaunchKernel(CUfunction f,
+                                unsigned int gridDimX, unsigned int, unsigned int,
+                                unsigned int blockDimX, unsigned int, unsigned int,
+                                unsigned int, CUstream, void **kernelParams, void **)
+{
+    const HostKernel *kernel = (const HostKernel*)f;
+    if (!kernel || !kernelParams)
+        return CUDA_ERROR_INVALID_VALUE;
+    kernel->launch(gridDimX, blockDimX, kernelParams);
+    return CUDA_SUCCESS;
+}
+
+#endif // CPU_DRIVER_H
@@ -0,0 +1,147 @@
+/*
+ * Accounting of device and pinned host allocations.
+ *
+ * Every allocation is tagged with a purpose (a short static string such as
+ * "input" or "output") and the job it belongs to. The ledger keeps, per
+ * memory space and per purpose, the live and peak bytes and the number of
+ * allocations and frees, plus the live bytes of each job. Bytes are counted
+ * as granted, i.e. after rounding to the pool's size class; the difference
+ * to what was requested is reported as internal fragmentation.
+ */
+
+#ifndef CUDA_ACCOUNTING_H
+#define CUDA_ACCOUNTING_H
+
+#include <stdio.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+enum MemorySpace {
+    MEM_DEVICE,
+    MEM_PINNED,
+    MEM_SPACES,
+    MEM_PAGEABLE = MEM_SPACES   // ordinary host memory, not in the ledger
+};
+
+struct MemoryCounters {
+    size_t liveBytes;
+    size_t peakBytes;
+    size_t requestedLiveBytes;
+    size_t allocations;
+    size_t frees;
+
+    MemoryCounters() : liveBytes(0), peakBytes(0), requestedLiveBytes(0),
+                       allocations(0), frees(0) {}
+
+    void add(size_t requested, size_t granted)
+    {
+        liveBytes += granted;
+        requestedLiveBytes += requested;
+        if (liveBytes > peakBytes)
+            peakBytes = liveBytes;
+        ++allocations;
+    }
+
+    void remove(size_t requested, size_t granted)
+    {
+        liveBytes -= granted;
+        requestedLiveBytes -= requested;
+        ++frees;
+    }
+};
+
+class MemoryLedger {
+public:
+    void recordAlloc(MemorySpace space, const void *ptr, size_t requested, size_t granted,
+                     const char *purpose, int job)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Allocation &rec = live[space][ptr];
+        rec.requested = requested;
+        rec.granted = granted;
+        rec.purpose = purpose;
+        rec.job = job;
+        totals[space].add(requested, granted);
+        byPurpose[space][purpose].add(requested, granted);
+        jobLiveBytes[job] += granted;
+    }
+
+    // Unknown pointers are ignored, so untracked memory may be freed too.
+    void recordFree(MemorySpace space, const void *ptr)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unordered_map<const void*, Allocation>::iterator it = live[space].find(ptr);
+        if (it == live[space].end())
+            return;
+        const Allocation &rec = it->second;
+        totals[space].remove(rec.requested, rec.granted);
+        byPurpose[space][rec.purpose].remove(rec.requested, rec.granted);
+        if ((jobLiveBytes[rec.job] -= rec.granted) == 0)
+            jobLiveBytes.erase(rec.job);
+        live[space].erase(it);
+    }
+
+    MemoryCounters counters(MemorySpace space) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return totals[space];
+    }
+
+    size_t jobBytes(int job) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<int, size_t>::const_iterator it = jobLiveBytes.find(job);
+        return it == jobLiveBytes.end() ? 0 : it->second;
+    }
+
+    // poolReserved/poolCached describe the device pool: bytes held from the
+    // driver and the part of them that sits idle in its free lists.
+    void print(size_t poolReserved, size_t poolCached) const
+    {
+        static const char *spaceNames[MEM_SPACES] = { "device", "pinned" };
+        std::lock_guard<std::mutex> lock(mutex);
+
+        printf("> Memory report:\n");
+        for (int s = 0; s < MEM_SPACES; ++s) {
+            const MemoryCounters &t = totals[s];
+            printf("  %-7s live %llu bytes, peak %llu bytes, %llu allocs, %llu frees\n",
+                   spaceNames[s], (unsigned long long)t.liveBytes,
+                   (unsigned long long)t.peakBytes, (unsigned long long)t.allocations,
+                   (unsigned long long)t.frees);
+            std::map<std::string, MemoryCounters>::const_iterator it;
+            for (it = byPurpose[s].begin(); it != byPurpose[s].end(); ++it)
+                printf("    %-12s live %llu bytes, peak %llu bytes, %llu allocs\n",
+                       it->first.c_str(), (unsigned long long)it->second.liveBytes,
+                       (unsigned long long)it->second.peakBytes,
+                       (unsigned long long)it->second.allocations);
+            if (t.liveBytes > 0)
+                printf("    internal fragmentation: %.1f%% of live bytes\n",
+                       100.0 * (t.liveBytes - t.requestedLiveBytes) / t.liveBytes);
+        }
+        if (poolReserved > 0)
+            printf("  device pool: %llu bytes reserved, %llu idle (%.1f%%)\n",
+                   (unsigned long long)poolReserved, (unsigned long long)poolCached,
+                   100.0 * poolCached / poolReserved);
+        std::map<int, size_t>::const_iterator j;
+        for (j = jobLiveBytes.begin(); j != jobLiveBytes.end(); ++j)
+            printf("  job %d still holds %llu bytes\n", j->first, (unsigned long long)j->second);
+    }
+
+private:
+    struct Allocation {
+        size_t      requested;
+        size_t      granted;
+        const char *purpose;
+        int         job;
+    };
+
+    mutable std::mutex                                  mutex;
+    std::unordered_map<const void*, Allocation>         live[MEM_SPACES];
+    MemoryCounters                                      totals[MEM_SPACES];
+    std::map<std::string, MemoryCounters>               byPurpose[MEM_SPACES];
+    std::map<int, size_t>                               jobLiveBytes;
+};
+
+#endif // CUDA_ACCOUNTING_H
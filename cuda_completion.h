@@ -0,0 +1,126 @@
+/*
+ * Non-blocking completion notification for stream work.
+ *
+ *     CompletionThread completions;
+ *     std::future<CUresult> done = completions.submit(stream);
+ *     completions.submit(stream, [] { ... });
+ *
+ * submit() enqueues a cuLaunchHostFunc() callback behind the work already
+ * queued on the stream (typically the final DtoH copy of a job). Host
+ * functions may not call into the driver, so the callback only hands the
+ * job to a dedicated completion thread. That thread runs the user callback
+ * and fulfils the future, and the callback is free to use the driver.
+ */
+
+#ifndef CUDA_COMPLETION_H
+#define CUDA_COMPLETION_H
+
+#include <cuda.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+#include "cuda_driver.h"
+
+class CompletionThread {
+public:
+    CompletionThread() : stopping(false), worker(&CompletionThread::loop, this) {}
+
+    // Drains every completion already delivered, then stops.
+    ~CompletionThread()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+    CompletionThread(const CompletionThread &) = delete;
+    CompletionThread &operator=(const CompletionThread &) = delete;
+
+    // Run callback on the completion thread once the stream reaches this
+    // point. Returns the enqueue error, if any, in which case the callback
+    // never runs.
+    CUresult submit(CUstream stream, std::function<void()> callback)
+    {
+        Pending *p = new Pending();
+        p->owner = this;
+        p->callback = std::move(callback);
+        return enqueue(stream, p);
+    }
+
+    // Future form: becomes ready with CUDA_SUCCESS once the stream reaches
+    // this point, or immediately with the enqueue error.
+    std::future<CUresult> submit(CUstream stream)
+    {
+        Pending *p = new Pending();
+        p->owner = this;
+        p->notify = true;
+        std::future<CUresult> done = p->promise.get_future();
+        enqueue(stream, p);
+        return done;
+    }
+
+private:
+    struct Pending {
+        CompletionThread       *owner;
+        std::function<void()>   callback;
+        bool                    notify = false;
+        std::promise<CUresult>  promise;
+    };
+
+    CUresult enqueue(CUstream stream, Pending *p)
+    {
+        CUresult err = drv.cuLaunchHostFunc(stream, onStreamDone, p);
+        if (err != CUDA_SUCCESS) {
+            if (p->notify)
+                p->promise.set_value(err);
+            delete p;
+        }
+        return err;
+    }
+
+    // Runs on a driver thread: hand off and return immediately.
+    static void CUDAAPI onStreamDone(void *userData)
+    {
+        Pending *p = (Pending*)userData;
+        CompletionThread *self = p->owner;
+        {
+            std::lock_guard<std::mutex> lock(self->mutex);
+            self->ready.push_back(p);
+        }
+        self->wake.notify_one();
+    }
+
+    void loop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wake.wait(lock, [this] { return stopping || !ready.empty(); });
+            if (ready.empty())
+                return;
+            Pending *p = ready.front();
+            ready.pop_front();
+            lock.unlock();
+            if (p->callback)
+                p->callback();
+            if (p->notify)
+                p->promise.set_value(CUDA_SUCCESS);
+            delete p;
+            lock.lock();
+        }
+    }
+
+    std::mutex              mutex;
+    std::condition_variable wake;
+    std::deque<Pending*>    ready;
+    bool                    stopping;
+    std::thread             worker;
+};
+
+#endif // CUDA_COMPLETION_H
@@ -0,0 +1,154 @@
+/*
+ * Move-only owners of a context and a module (cuda_handles.h has the
+ * rest). They only need the driver table, so cuda_helper.h can hold its
+ * per-device contexts and the kernel module in them; a context is
+ * destroyed, and a module unloaded, exactly once by whoever holds it last.
+ */
+
+#ifndef CUDA_CONTEXT_H
+#define CUDA_CONTEXT_H
+
+#include <stdio.h>
+#include <cuda.h>
+
+#include "cuda_driver.h"
+
+// Errors while giving a resource back cannot be returned from a destructor.
+inline void reportReleaseError(CUresult err, const char *what)
+{
+    if (err != CUDA_SUCCESS)
+        fprintf(stderr, "Warning: releasing %s failed (error %04d)\n", what, err);
+}
+
+// Makes ctx current on the calling thread for the lifetime of the scope,
+// so that a resource can be given back in the context it belongs to
+// whichever context the caller has current.
+class ContextScope {
+public:
+    explicit ContextScope(CUcontext ctx) : saved(NULL), switched(false)
+    {
+        if (ctx && drv.cuCtxGetCurrent(&saved) == CUDA_SUCCESS && saved != ctx)
+            switched = drv.cuCtxSetCurrent(ctx) == CUDA_SUCCESS;
+    }
+    ~ContextScope()
+    {
+        if (switched)
+            drv.cuCtxSetCurrent(saved);
+    }
+
+    ContextScope(const ContextScope &) = delete;
+    ContextScope &operator=(const ContextScope &) = delete;
+
+private:
+    CUcontext saved;
+    bool      switched;
+};
+
+// --- context -------------------------------------------------------------
+class Context {
+public:
+    Context() : ctx(NULL) {}
+    ~Context() { reset(); }
+
+    Context(const Context &) = delete;
+    Context &operator=(const Context &) = delete;
+    Context(Context &&other) noexcept : ctx(other.ctx) { other.ctx = NULL; }
+    Context &operator=(Context &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            ctx = other.ctx;
+            other.ctx = NULL;
+        }
+        return *this;
+    }
+
+    // Created current on the calling thread.
+    CUresult create(CUdevice dev, unsigned int flags = 0)
+    {
+        reset();
+        CUresult err = drv.cuCtxCreate(&ctx, flags, dev);
+        if (err != CUDA_SUCCESS)
+            ctx = NULL;
+        return err;
+    }
+
+    void reset()
+    {
+        if (ctx)
+            reportReleaseError(drv.cuCtxDestroy(ctx), "context");
+        ctx = NULL;
+    }
+
+    CUcontext release() { CUcontext c = ctx; ctx = NULL; return c; }
+    CUcontext get() const { return ctx; }
+
+private:
+    CUcontext ctx;
+};
+
+// --- module --------------------------------------------------------------
+// Unloaded in the context it was loaded into.
+class Module {
+public:
+    Module() : mod(NULL), ctx(NULL) {}
+    ~Module() { reset(); }
+
+    Module(const Module &) = delete;
+    Module &operator=(const Module &) = delete;
+    Module(Module &&other) noexcept : mod(other.mod), ctx(other.ctx)
+    {
+        other.mod = NULL;
+        other.ctx = NULL;
+    }
+    Module &operator=(Module &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            mod = other.mod;
+            ctx = other.ctx;
+            other.mod = NULL;
+            other.ctx = NULL;
+        }
+        return *this;
+    }
+
+    // Loaded into the context current on the calling thread.
+    CUresult load(const char *file)
+    {
+        reset();
+        CUresult err = drv.cuCtxGetCurrent(&ctx);
+        if (err == CUDA_SUCCESS)
+            err = drv.cuModuleLoad(&mod, file);
+        if (err != CUDA_SUCCESS) {
+            mod = NULL;
+            ctx = NULL;
+        }
+        return err;
+    }
+
+    // The function lives as long as the module does.
+    CUresult getFunction(CUfunction *fn, const char *name) const
+    {
+        return drv.cuModuleGetFunction(fn, mod, name);
+    }
+
+    void reset()
+    {
+        if (mod) {
+            ContextScope scope(ctx);
+            reportReleaseError(drv.cuModuleUnload(mod), "module");
+        }
+        mod = NULL;
+        ctx = NULL;
+    }
+
+    CUmodule release() { CUmodule m = mod; mod = NULL; ctx = NULL; return m; }
+    CUmodule get() const { return mod; }
+
+private:
+    CUmodule  mod;
+    CUcontext ctx;
+};
+
+#endif // CUDA_CONTEXT_H
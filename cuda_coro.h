@@ -0,0 +1,243 @@
+/*
+ * C++20 coroutine front end for stream work.
+ *
+ *     Job run(Reactor &r, CUstream s, ...)
+ *     {
+ *         co_await copy_to_device(r, s, d_a, a, bytes);
+ *         co_await launch(r, s, function, grid, block, args);
+ *         co_await copy_to_host(r, s, c, d_c, bytes);
+ *     }
+ *
+ * The copies also take a device_span and a host_span of equal length in
+ * place of the pointers and byte count.
+ *
+ * Each awaitable enqueues its operation on the stream followed by a
+ * cuLaunchHostFunc() callback, then suspends. The callback runs on a
+ * driver thread and only hands the coroutine back to the Reactor; the
+ * thread inside Reactor::run() resumes it. One host thread can therefore
+ * keep any number of jobs in flight without blocking on any of them.
+ */
+
+#ifndef CUDA_CORO_H
+#define CUDA_CORO_H
+
+#include <cuda.h>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <type_traits>
+
+#include "cuda_driver.h"
+#include "cuda_span.h"
+
+// --- reactor -------------------------------------------------------------
+class Reactor {
+public:
+    // Called from driver callback threads.
+    void post(std::coroutine_handle<> h)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.push_back(h);
+        }
+        wake.notify_one();
+    }
+
+    // Resume completed coroutines until every Job has finished.
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (live > 0) {
+            wake.wait(lock, [this] { return !ready.empty() || live == 0; });
+            while (!ready.empty()) {
+                std::coroutine_handle<> h = ready.front();
+                ready.pop_front();
+                lock.unlock();
+                h.resume();
+                lock.lock();
+            }
+        }
+    }
+
+    void jobStarted()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++live;
+    }
+
+    void jobFinished()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --live;
+        }
+        wake.notify_one();
+    }
+
+private:
+    std::mutex                          mutex;
+    std::condition_variable             wake;
+    std::deque<std::coroutine_handle<>> ready;
+    int                                 live = 0;
+};
+
+// --- jobs ----------------------------------------------------------------
+// Fire-and-forget coroutine. It starts running immediately and frees its
+// own frame when it returns; the reactor passed as its first argument
+// tracks it until then.
+struct Job {
+    struct promise_type {
+        Reactor *reactor;
+
+        template <typename... Args>
+        promise_type(Reactor &r, Args &&...) : reactor(&r) { reactor->jobStarted(); }
+        ~promise_type() { reactor->jobFinished(); }
+
+        Job get_return_object() { return Job(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// --- awaitables ----------------------------------------------------------
+// Base for operations that complete in stream order. enqueue() issues the
+// operation; co_await yields its CUresult, or the error from cuLaunchHostFunc.
+class StreamAwaitable {
+public:
+    StreamAwaitable(Reactor &r, CUstream s) : reactor(r), stream(s) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    // Once the callback is queued the coroutine may be resumed, and this
+    // awaitable destroyed, on another thread: touch no members after it.
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        handle = h;
+        if ((result = enqueue()) != CUDA_SUCCESS)
+            return false;
+        CUresult err = drv.cuLaunchHostFunc(stream, onComplete, this);
+        if (err != CUDA_SUCCESS) {
+            result = err;
+            return false;
+        }
+        return true;
+    }
+
+    CUresult await_resume() const noexcept { return result; }
+
+protected:
+    virtual CUresult enqueue() = 0;
+    ~StreamAwaitable() = default;
+
+    Reactor &reactor;
+    CUstream stream;
+
+private:
+    static void CUDAAPI onComplete(void *userData)
+    {
+        StreamAwaitable *self = (StreamAwaitable*)userData;
+        self->reactor.post(self->handle);
+    }
+
+    std::coroutine_handle<> handle;
+    CUresult                result = CUDA_SUCCESS;
+};
+
+// A copy between views of different lengths fails with
+// CUDA_ERROR_INVALID_VALUE when awaited.
+class CopyToDevice final : public StreamAwaitable {
+public:
+    CopyToDevice(Reactor &r, CUstream s, CUdeviceptr dst, const void *src, size_t bytes,
+                 bool valid = true)
+        : StreamAwaitable(r, s), dst(dst), src(src), bytes(bytes), valid(valid) {}
+
+protected:
+    CUresult enqueue() override
+    {
+        if (!valid)
+            return CUDA_ERROR_INVALID_VALUE;
+        return drv.cuMemcpyHtoDAsync(dst, src, bytes, stream);
+    }
+
+private:
+    CUdeviceptr dst;
+    const void *src;
+    size_t      bytes;
+    bool        valid;
+};
+
+class CopyToHost final : public StreamAwaitable {
+public:
+    CopyToHost(Reactor &r, CUstream s, void *dst, CUdeviceptr src, size_t bytes,
+               bool valid = true)
+        : StreamAwaitable(r, s), dst(dst), src(src), bytes(bytes), valid(valid) {}
+
+protected:
+    CUresult enqueue() override
+    {
+        if (!valid)
+            return CUDA_ERROR_INVALID_VALUE;
+        return drv.cuMemcpyDtoHAsync(dst, src, bytes, stream);
+    }
+
+private:
+    void       *dst;
+    CUdeviceptr src;
+    size_t      bytes;
+    bool        valid;
+};
+
+// 1-D launch; args must stay valid until the awaitable is co_awaited.
+class Launch final : public StreamAwaitable {
+public:
+    Launch(Reactor &r, CUstream s, CUfunction f, unsigned grid, unsigned block, void **args)
+        : StreamAwaitable(r, s), function(f), grid(grid), block(block), args(args) {}
+
+protected:
+    CUresult enqueue() override
+    {
+        return drv.cuLaunchKernel(function, grid, 1, 1, block, 1, 1, 0, stream, args, 0);
+    }
+
+private:
+    CUfunction function;
+    unsigned   grid, block;
+    void     **args;
+};
+
+inline CopyToDevice copy_to_device(Reactor &r, CUstream s, CUdeviceptr dst, const void *src, size_t bytes)
+{
+    return CopyToDevice(r, s, dst, src, bytes);
+}
+
+inline CopyToHost copy_to_host(Reactor &r, CUstream s, void *dst, CUdeviceptr src, size_t bytes)
+{
+    return CopyToHost(r, s, dst, src, bytes);
+}
+
+template <typename T, typename U>
+inline CopyToDevice copy_to_device(Reactor &r, CUstream s, device_span<T> dst, host_span<U> src)
+{
+    static_assert(std::is_same<typename std::remove_const<U>::type, T>::value,
+                  "copy_to_device: element types differ");
+    return CopyToDevice(r, s, dst.data(), src.data(), src.bytes(), dst.size() == src.size());
+}
+
+template <typename T, typename U>
+inline CopyToHost copy_to_host(Reactor &r, CUstream s, host_span<T> dst, device_span<U> src)
+{
+    static_assert(std::is_same<typename std::remove_const<U>::type, T>::value,
+                  "copy_to_host: element types differ");
+    return CopyToHost(r, s, dst.data(), src.data(), src.bytes(), dst.size() == src.size());
+}
+
+inline Launch launch(Reactor &r, CUstream s, CUfunction f, unsigned grid, unsigned block, void **args)
+{
+    return Launch(r, s, f, grid, block, args);
+}
+
+#endif // CUDA_CORO_H
@@ -0,0 +1,196 @@
+/*
+ * Driver entry points resolved at run time.
+ *
+ * The examples do not link against libcuda. loadCudaDriver() opens it with
+ * dlopen() and fills the function table drv through dlsym(); when the
+ * library is missing, a symbol cannot be resolved or cuInit() fails, the
+ * table is filled with the CPU stand-in from cpu_driver.h instead. Setting
+ * VADD_BACKEND=cpu selects the CPU backend unconditionally, and
+ * VADD_CPU_DEVICES=<n> makes it report n devices.
+ *
+ * Call sites go through the table: drv.cuMemAlloc(...).
+ */
+
+#ifndef CUDA_DRIVER_H
+#define CUDA_DRIVER_H
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cuda.h>
+
+#include "cpu_driver.h"
+
+// Every driver function used by the examples. cuda.h maps several of these
+// names to versioned symbols (cuMemAlloc -> cuMemAlloc_v2), which the table
+// members and the dlsym() lookups follow automatically.
+#define CUDA_DRIVER_ENTRY_POINTS(X) \
+    X(cuInit)                       \
+    X(cuDeviceGetCount)             \
+    X(cuDeviceGet)                  \
+    X(cuDeviceGetName)              \
+    X(cuDeviceGetAttribute)         \
+    X(cuDeviceTotalMem)             \
+    X(cuDeviceCanAccessPeer)        \
+    X(cuDeviceGetPCIBusId)          \
+    X(cuCtxCreate)                  \
+    X(cuCtxDestroy)                 \
+    X(cuCtxSetCurrent)              \
+    X(cuCtxGetCurrent)              \
+    X(cuCtxEnablePeerAccess)        \
+    X(cuCtxGetStreamPriorityRange)  \
+    X(cuModuleLoad)                 \
+    X(cuModuleUnload)               \
+    X(cuModuleGetFunction)          \
+    X(cuMemGetInfo)                 \
+    X(cuMemAlloc)                   \
+    X(cuMemFree)                    \
+    X(cuMemAllocHost)               \
+    X(cuMemFreeHost)                \
+    X(cuMemcpyHtoD)                 \
+    X(cuMemcpyDtoH)                 \
+    X(cuMemcpyHtoDAsync)            \
+    X(cuMemcpyDtoHAsync)            \
+    X(cuMemcpyPeerAsync)            \
+    X(cuIpcGetMemHandle)            \
+    X(cuIpcOpenMemHandle)           \
+    X(cuIpcCloseMemHandle)          \
+    X(cuStreamCreate)               \
+    X(cuStreamCreateWithPriority)   \
+    X(cuStreamDestroy)              \
+    X(cuStreamSynchronize)          \
+    X(cuLaunchHostFunc)             \
+    X(cuEventCreate)                \
+    X(cuEventDestroy)               \
+    X(cuEventRecord)                \
+    X(cuEventQuery)                 \
+    X(cuEventSynchronize)           \
+    X(cuEventElapsedTime)           \
+    X(cuLaunchKernel)
+
+#define CUDA_SYMBOL_(name) #name
+#define CUDA_SYMBOL(name)  CUDA_SYMBOL_(name)
+
+struct CudaDriver {
+#define X(fn) decltype(&::fn) fn;
+    CUDA_DRIVER_ENTRY_POINTS(X)
+#undef X
+};
+
+enum CudaBackend {
+    BACKEND_NONE,
+    BACKEND_CUDA,
+    BACKEND_CPU
+};
+
+CudaDriver  drv;
+CudaBackend backend = BACKEND_NONE;
+void       *libcuda = NULL;
+bool        driverQuiet = false;    // set by libraries that must not print
+
+inline void useCpuDriver(const char *reason)
+{
+    drv.cuInit               = cpuInit;
+    drv.cuDeviceGetCount     = cpuDeviceGetCount;
+    drv.cuDeviceGet          = cpuDeviceGet;
+    drv.cuDeviceGetName      = cpuDeviceGetName;
+    drv.cuDeviceGetAttribute = cpuDeviceGetAttribute;
+    drv.cuDeviceTotalMem     = cpuDeviceTotalMem;
+    drv.cuDeviceCanAccessPeer = cpuDeviceCanAccessPeer;
+    drv.cuDeviceGetPCIBusId  = cpuDeviceGetPCIBusId;
+    drv.cuCtxCreate          = cpuCtxCreate;
+    drv.cuCtxDestroy         = cpuCtxDestroy;
+    drv.cuCtxSetCurrent      = cpuCtxSetCurrent;
+    drv.cuCtxGetCurrent      = cpuCtxGetCurrent;
+    drv.cuCtxEnablePeerAccess = cpuCtxEnablePeerAccess;
+    drv.cuCtxGetStreamPriorityRange = cpuCtxGetStreamPriorityRange;
+    drv.cuModuleLoad         = cpuModuleLoad;
+    drv.cuModuleUnload       = cpuModuleUnload;
+    drv.cuModuleGetFunction  = cpuModuleGetFunction;
+    drv.cuMemGetInfo         = cpuMemGetInfo;
+    drv.cuMemAlloc           = cpuMemAlloc;
+    drv.cuMemFree            = cpuMemFree;
+    drv.cuMemAllocHost       = cpuMemAllocHost;
+    drv.cuMemFreeHost        = cpuMemFreeHost;
+    drv.cuMemcpyHtoD         = cpuMemcpyHtoD;
+    drv.cuMemcpyDtoH         = cpuMemcpyDtoH;
+    drv.cuMemcpyHtoDAsync    = cpuMemcpyHtoDAsync;
+    drv.cuMemcpyDtoHAsync    = cpuMemcpyDtoHAsync;
+    drv.cuMemcpyPeerAsync    = cpuMemcpyPeerAsync;
+    drv.cuIpcGetMemHandle    = cpuIpcGetMemHandle;
+    drv.cuIpcOpenMemHandle   = cpuIpcOpenMemHandle;
+    drv.cuIpcCloseMemHandle  = cpuIpcCloseMemHandle;
+    drv.cuStreamCreate       = cpuStreamCreate;
+    drv.cuStreamCreateWithPriority = cpuStreamCreateWithPriority;
+    drv.cuStreamDestroy      = cpuStreamDestroy;
+    drv.cuStreamSynchronize  = cpuStreamSynchronize;
+    drv.cuLaunchHostFunc     = cpuLaunchHostFunc;
+    drv.cuEventCreate        = cpuEventCreate;
+    drv.cuEventDestroy       = cpuEventDestroy;
+    drv.cuEventRecord        = cpuEventRecord;
+    drv.cuEventQuery         = cpuEventQuery;
+    drv.cuEventSynchronize   = cpuEventSynchronize;
+    drv.cuEventElapsedTime   = cpuEventElapsedTime;
+    drv.cuLaunchKernel       = cpuLaunchKernel;
+
+#define X(fn) \
+    if (!drv.fn) { fprintf(stderr, "* CPU backend lacks %s\n", CUDA_SYMBOL(fn)); exit(-1); }
+    CUDA_DRIVER_ENTRY_POINTS(X)
+#undef X
+
+    backend = BACKEND_CPU;
+    if (!driverQuiet)
+        printf("> Backend: CPU fallback (%s)\n", reason);
+}
+
+// Resolve every entry point from libcuda. Returns the name of the first
+// symbol that could not be found, or NULL on success.
+inline const char *resolveCudaDriver(void *lib)
+{
+#define X(fn) \
+    if (!(drv.fn = (decltype(drv.fn)) dlsym(lib, CUDA_SYMBOL(fn)))) return CUDA_SYMBOL(fn);
+    CUDA_DRIVER_ENTRY_POINTS(X)
+#undef X
+    return NULL;
+}
+
+// Select the backend once per process; later calls are no-ops.
+inline void loadCudaDriver()
+{
+    if (backend != BACKEND_NONE)
+        return;
+
+    const char *forced = getenv("VADD_BACKEND");
+    if (forced && strcmp(forced, "cpu") == 0) {
+        useCpuDriver("VADD_BACKEND=cpu");
+        return;
+    }
+
+    libcuda = dlopen("libcuda.so.1", RTLD_NOW | RTLD_LOCAL);
+    if (!libcuda) {
+        useCpuDriver("libcuda.so.1 not found");
+        return;
+    }
+
+    const char *missing = resolveCudaDriver(libcuda);
+    if (missing) {
+        if (!driverQuiet)
+            fprintf(stderr, "* libcuda does not export %s\n", missing);
+        memset(&drv, 0, sizeof(drv));
+        useCpuDriver("incomplete libcuda");
+        return;
+    }
+
+    if (drv.cuInit(0) != CUDA_SUCCESS) {
+        memset(&drv, 0, sizeof(drv));
+        useCpuDriver("cuInit failed");
+        return;
+    }
+
+    backend = BACKEND_CUDA;
+    if (!driverQuiet)
+        printf("> Backend: CUDA driver (libcuda.so.1)\n");
+}
+
+#endif // CUDA_DRIVER_H
@@ -0,0 +1,333 @@
+/*
+ * Move-only owners of driver resources.
+ *
+ * Each type holds one context, module, buffer, stream or event and gives
+ * it back when destroyed: contexts and modules to the driver, buffers to
+ * devicePool (device) or to the driver (pinned) through the tracked
+ * allocators, streams and events to the pool they came from. The owners
+ * cannot be copied, only moved, so a buffer handed from one pipeline stage
+ * to the next changes owner without a copy or a reference count, and is
+ * freed exactly once by whoever holds it last. Context and Module are in
+ * cuda_context.h, since cuda_helper.h holds its own in them.
+ *
+ * Resources are obtained with a member returning CUresult, like the pools:
+ *
+ *     DeviceBuffer<int> d_a;
+ *     checkCudaErrors( d_a.allocate(n, "input", job) );
+ *
+ * and can be returned early with reset() or handed over with release().
+ * Buffer, stream and event owners must be gone before finalizeCUDA()
+ * clears the pools and destroys the contexts.
+ */
+
+#ifndef CUDA_HANDLES_H
+#define CUDA_HANDLES_H
+
+#include <stdio.h>
+#include <cuda.h>
+
+#include "cuda_context.h"
+#include "cuda_helper.h"
+#include "cuda_span.h"
+
+// --- device buffer -------------------------------------------------------
+// count elements of T in a devicePool block.
+template <typename T>
+class DeviceBuffer {
+public:
+    DeviceBuffer() : ptr(0), count(0) {}
+    ~DeviceBuffer() { reset(); }
+
+    DeviceBuffer(const DeviceBuffer &) = delete;
+    DeviceBuffer &operator=(const DeviceBuffer &) = delete;
+    DeviceBuffer(DeviceBuffer &&other) noexcept : ptr(other.ptr), count(other.count)
+    {
+        other.ptr = 0;
+        other.count = 0;
+    }
+    DeviceBuffer &operator=(DeviceBuffer &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            ptr = other.ptr;
+            count = other.count;
+            other.ptr = 0;
+            other.count = 0;
+        }
+        return *this;
+    }
+
+    CUresult allocate(size_t n, const char *purpose, int job = 0)
+    {
+        reset();
+        CUresult err = allocDevice(&ptr, sizeof(T) * n, purpose, job);
+        if (err != CUDA_SUCCESS)
+            ptr = 0;
+        else
+            count = n;
+        return err;
+    }
+
+    void reset()
+    {
+        if (ptr)
+            reportReleaseError(freeDevice(ptr), "device buffer");
+        ptr = 0;
+        count = 0;
+    }
+
+    // The caller frees the block with freeDevice().
+    CUdeviceptr release() { CUdeviceptr p = ptr; ptr = 0; count = 0; return p; }
+
+    CUdeviceptr get() const   { return ptr; }
+    size_t      size() const  { return count; }
+    size_t      bytes() const { return sizeof(T) * count; }
+
+    device_span<T> span() const { return device_span<T>(ptr, count); }
+
+private:
+    CUdeviceptr ptr;
+    size_t      count;
+};
+
+// --- peer buffer ---------------------------------------------------------
+// count elements of T straight from the driver in the context current at
+// allocate(), for devices other than device 0, which devicePool and the
+// ledger do not cover. Freed in that context.
+template <typename T>
+class PeerBuffer {
+public:
+    PeerBuffer() : ptr(0), count(0), ctx(NULL) {}
+    ~PeerBuffer() { reset(); }
+
+    PeerBuffer(const PeerBuffer &) = delete;
+    PeerBuffer &operator=(const PeerBuffer &) = delete;
+    PeerBuffer(PeerBuffer &&other) noexcept : ptr(other.ptr), count(other.count), ctx(other.ctx)
+    {
+        other.ptr = 0;
+        other.count = 0;
+        other.ctx = NULL;
+    }
+    PeerBuffer &operator=(PeerBuffer &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            ptr = other.ptr;
+            count = other.count;
+            ctx = other.ctx;
+            other.ptr = 0;
+            other.count = 0;
+            other.ctx = NULL;
+        }
+        return *this;
+    }
+
+    CUresult allocate(size_t n)
+    {
+        reset();
+        CUresult err = drv.cuCtxGetCurrent(&ctx);
+        if (err == CUDA_SUCCESS)
+            err = drv.cuMemAlloc(&ptr, sizeof(T) * n);
+        if (err != CUDA_SUCCESS) {
+            ptr = 0;
+            ctx = NULL;
+        } else {
+            count = n;
+        }
+        return err;
+    }
+
+    void reset()
+    {
+        if (ptr) {
+            ContextScope scope(ctx);
+            reportReleaseError(drv.cuMemFree(ptr), "peer buffer");
+        }
+        ptr = 0;
+        count = 0;
+        ctx = NULL;
+    }
+
+    // The caller frees the memory with cuMemFree() in its context.
+    CUdeviceptr release() { CUdeviceptr p = ptr; ptr = 0; count = 0; ctx = NULL; return p; }
+
+    CUdeviceptr get() const   { return ptr; }
+    size_t      size() const  { return count; }
+    size_t      bytes() const { return sizeof(T) * count; }
+
+    device_span<T> span() const { return device_span<T>(ptr, count); }
+
+private:
+    CUdeviceptr ptr;
+    size_t      count;
+    CUcontext   ctx;
+};
+
+// --- pinned buffer -------------------------------------------------------
+// count elements of T in page-locked host memory.
+template <typename T>
+class PinnedBuffer {
+public:
+    PinnedBuffer() : ptr(NULL), count(0) {}
+    ~PinnedBuffer() { reset(); }
+
+    PinnedBuffer(const PinnedBuffer &) = delete;
+    PinnedBuffer &operator=(const PinnedBuffer &) = delete;
+    PinnedBuffer(PinnedBuffer &&other) noexcept : ptr(other.ptr), count(other.count)
+    {
+        other.ptr = NULL;
+        other.count = 0;
+    }
+    PinnedBuffer &operator=(PinnedBuffer &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            ptr = other.ptr;
+            count = other.count;
+            other.ptr = NULL;
+            other.count = 0;
+        }
+        return *this;
+    }
+
+    CUresult allocate(size_t n, const char *purpose, int job = 0)
+    {
+        reset();
+        CUresult err = allocPinned((void**)&ptr, sizeof(T) * n, purpose, job);
+        if (err != CUDA_SUCCESS)
+            ptr = NULL;
+        else
+            count = n;
+        return err;
+    }
+
+    void reset()
+    {
+        if (ptr)
+            reportReleaseError(freePinned(ptr), "pinned buffer");
+        ptr = NULL;
+        count = 0;
+    }
+
+    // The caller frees the memory with freePinned().
+    T *release() { T *p = ptr; ptr = NULL; count = 0; return p; }
+
+    T       *data() const  { return ptr; }
+    size_t   size() const  { return count; }
+    size_t   bytes() const { return sizeof(T) * count; }
+    T       &operator[](size_t i) const { return ptr[i]; }
+
+    host_span<T> span() const { return host_span<T>(ptr, count, MEM_PINNED); }
+
+private:
+    T      *ptr;
+    size_t  count;
+};
+
+// --- stream --------------------------------------------------------------
+// A stream borrowed from streamPools[priority].
+class Stream {
+public:
+    Stream() : stream(NULL), pool(NULL) {}
+    ~Stream() { reset(); }
+
+    Stream(const Stream &) = delete;
+    Stream &operator=(const Stream &) = delete;
+    Stream(Stream &&other) noexcept : stream(other.stream), pool(other.pool)
+    {
+        other.stream = NULL;
+        other.pool = NULL;
+    }
+    Stream &operator=(Stream &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            stream = other.stream;
+            pool = other.pool;
+            other.stream = NULL;
+            other.pool = NULL;
+        }
+        return *this;
+    }
+
+    CUresult acquire(JobPriority priority = JOB_BULK)
+    {
+        reset();
+        CUresult err = streamPools[priority].acquire(&stream);
+        if (err == CUDA_SUCCESS)
+            pool = &streamPools[priority];
+        else
+            stream = NULL;
+        return err;
+    }
+
+    // Back to the pool; work still queued on it is not waited for.
+    void reset()
+    {
+        if (pool)
+            pool->release(stream);
+        stream = NULL;
+        pool = NULL;
+    }
+
+    CUstream get() const { return stream; }
+
+private:
+    CUstream    stream;
+    StreamPool *pool;
+};
+
+// --- event ---------------------------------------------------------------
+// An event borrowed from eventPool, or timedEventPool when timing is asked.
+class Event {
+public:
+    Event() : event(NULL), pool(NULL) {}
+    ~Event() { reset(); }
+
+    Event(const Event &) = delete;
+    Event &operator=(const Event &) = delete;
+    Event(Event &&other) noexcept : event(other.event), pool(other.pool)
+    {
+        other.event = NULL;
+        other.pool = NULL;
+    }
+    Event &operator=(Event &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            event = other.event;
+            pool = other.pool;
+            other.event = NULL;
+            other.pool = NULL;
+        }
+        return *this;
+    }
+
+    CUresult acquire(bool timing = false)
+    {
+        reset();
+        EventPool *from = timing ? &timedEventPool : &eventPool;
+        CUresult err = from->acquire(&event);
+        if (err == CUDA_SUCCESS)
+            pool = from;
+        else
+            event = NULL;
+        return err;
+    }
+
+    void reset()
+    {
+        if (pool)
+            pool->release(event);
+        event = NULL;
+        pool = NULL;
+    }
+
+    CUevent get() const { return event; }
+
+private:
+    CUevent    event;
+    EventPool *pool;
+};
+
+#endif // CUDA_HANDLES_H
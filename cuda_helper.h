@@ -0,0 +1,556 @@
+/*
+ * Shared driver set-up for the examples: error checking, device probing,
+ * context creation and module load.
+ *
+ * Ref:
+ * https://docs.nvidia.com/cuda/cuda-driver-api
+ */
+
+#ifndef CUDA_HELPER_H
+#define CUDA_HELPER_H
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cuda.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "cost_model.h"
+#include "cuda_accounting.h"
+#include "cuda_context.h"
+#include "cuda_driver.h"
+#include "cuda_memory.h"
+#include "cuda_metrics.h"
+#include "cuda_pool.h"
+#include "cuda_roofline.h"
+#include "cuda_trace.h"
+#include "host_add.h"
+
+// This will output the proper CUDA error strings
+// in the event that a CUDA host call returns an error
+#define checkCudaErrors(err)  __checkCudaErrors (err, __FILE__, __LINE__)
+
+inline void __checkCudaErrors( CUresult err, const char *file, const int line )
+{
+    if( CUDA_SUCCESS != err) {
+        fprintf(stderr,
+                "CUDA Driver API error = %04d from file <%s>, line %i.\n",
+                err, file, line );
+        exit(-1);
+    }
+}
+
+// --- startup profiling ---------------------------------------------------
+// Wall-clock time of each start-up phase, in milliseconds. For the phases
+// that run once per device concurrently, this is the slowest device.
+struct StartupProfile {
+    double cuInit;
+    double probe;
+    double context;
+    double module;
+};
+
+typedef std::chrono::steady_clock startup_clock;
+
+inline double elapsedMs(startup_clock::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(startup_clock::now() - since).count();
+}
+
+// --- per-device state ----------------------------------------------------
+struct DeviceInfo {
+    CUdevice  device;
+    char      name[100];
+    int       major, minor;
+    size_t    totalGlobalMem;
+    int       hasUVA;
+    int       memoryClockKHz;
+    int       busWidthBits;
+    char      pciBusId[32];   // empty when the backend has no bus
+    Context   context;
+    CUresult  status;       // first failing call while probing, if any
+    double    probeMs;
+    double    contextMs;
+};
+
+// Handles created up front by initCUDA(); the pools grow past this on demand.
+#define EVENT_POOL_SIZE  32
+#define STREAM_POOL_SIZE 8         // per priority class
+
+// Fraction of the free device memory that admission control leaves alone.
+#define ADMISSION_HEADROOM 0.10
+
+// Offload model calibration: rounds timed (best one counts) and the size of
+// the large probe job.
+#define SMALL_N_ROUNDS 5
+#define OFFLOAD_PROBE  (1 << 18)
+
+// --- global variables ----------------------------------------------------
+CUdevice   device;
+CUcontext  context;         // device 0's, owned by devices[0].context
+CUfunction function;        // lives in module
+size_t     totalGlobalMem;
+
+char       *module_file = (char*) "kernel.ptx";
+char       *kernel_name = (char*) "Sum";
+
+std::vector<DeviceInfo> devices;
+Module                  module;                 // declared after devices: unloaded before they go
+StartupProfile          startupProfile;
+std::thread             initThread;
+bool                    initFailed = false;     // set by the init thread, read after join
+
+EventPool               eventPool;              // no timing
+EventPool               timedEventPool(true);
+StreamPool              streamPools[JOB_PRIORITIES];
+
+DeviceMemoryPool        devicePool;
+AdmissionController     admission;
+MemoryLedger            memoryLedger;
+Roofline                roofline;               // peaks of device 0
+
+OffloadModel            offloadModel;
+HostAddPool             hostPool;
+int                     smallNThreshold = 0;    // jobs up to this size stay on the host
+bool                    fixedSmallN = false;    // ... set by VADD_SMALL_N, not the model
+CoexecSplit             coexecSplit;
+bool                    coexec = false;         // split device jobs with the host (VADD_COEXEC)
+const char             *coexecState = NULL;     // share kept across runs (VADD_COEXEC_STATE)
+
+// --- functions -----------------------------------------------------------
+
+// Query one device and create its context. Runs on its own thread, one per
+// device, so nothing in here may exit the process.
+inline void probeDevice(DeviceInfo *info, int ordinal)
+{
+    startup_clock::time_point t0 = startup_clock::now();
+    CUresult err;
+
+    info->context.reset();
+    if ((err = drv.cuDeviceGet(&info->device, ordinal)) != CUDA_SUCCESS ||
+        (err = drv.cuDeviceGetName(info->name, sizeof(info->name), info->device)) != CUDA_SUCCESS ||
+        (err = drv.cuDeviceGetAttribute(&info->major, CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MAJOR, info->device)) != CUDA_SUCCESS ||
+        (err = drv.cuDeviceGetAttribute(&info->minor, CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MINOR, info->device)) != CUDA_SUCCESS ||
+        (err = drv.cuDeviceTotalMem(&info->totalGlobalMem, info->device)) != CUDA_SUCCESS ||
+        (err = drv.cuDeviceGetAttribute(&info->hasUVA, CU_DEVICE_ATTRIBUTE_UNIFIED_ADDRESSING, info->device)) != CUDA_SUCCESS ||
+        (err = drv.cuDeviceGetAttribute(&info->memoryClockKHz, CU_DEVICE_ATTRIBUTE_MEMORY_CLOCK_RATE, info->device)) != CUDA_SUCCESS ||
+        (err = drv.cuDeviceGetAttribute(&info->busWidthBits, CU_DEVICE_ATTRIBUTE_GLOBAL_MEMORY_BUS_WIDTH, info->device)) != CUDA_SUCCESS) {
+        info->status = err;
+        info->probeMs = elapsedMs(t0);
+        return;
+    }
+    if (drv.cuDeviceGetPCIBusId(info->pciBusId, sizeof(info->pciBusId), info->device) != CUDA_SUCCESS)
+        info->pciBusId[0] = '\0';
+    info->probeMs = elapsedMs(t0);
+
+    t0 = startup_clock::now();
+    info->status = info->context.create(info->device);
+    info->contextMs = elapsedMs(t0);
+}
+
+inline void printDeviceInfo(int ordinal, const DeviceInfo &info)
+{
+    printf("> Device %d: %s\n", ordinal, info.name);
+    printf("> GPU Device has SM %d.%d compute capability\n", info.major, info.minor);
+    printf("  Total amount of global memory:   %llu bytes\n",
+           (unsigned long long)info.totalGlobalMem);
+    printf("  64-bit Memory Address:           %s\n",
+           (info.totalGlobalMem > (unsigned long long)4*1024*1024*1024L)?
+           "YES" : "NO");
+    printf("  Unified Virtual Addressing:      %s\n", info.hasUVA ? "YES" : "NO");
+    if (info.memoryClockKHz > 0)
+        printf("  Memory clock / bus width:        %d MHz / %d bits\n",
+               info.memoryClockKHz / 1000, info.busWidthBits);
+    if (info.pciBusId[0])
+        printf("  PCI bus id:                      %s\n", info.pciBusId);
+}
+
+inline void printStartupProfile()
+{
+    printf("> Startup phases:\n");
+    printf("  cuInit:                          %8.3f ms\n", startupProfile.cuInit);
+    printf("  device probing:                  %8.3f ms\n", startupProfile.probe);
+    printf("  context creation:                %8.3f ms\n", startupProfile.context);
+    printf("  module load:                     %8.3f ms\n", startupProfile.module);
+    for (size_t i = 0; i < devices.size(); ++i)
+        printf("    device %zu: probe %.3f ms, context %.3f ms\n",
+               i, devices[i].probeMs, devices[i].contextMs);
+}
+
+// Best-of-SMALL_N_ROUNDS phase times of one device job of n elements.
+inline CUresult timeDeviceJob(const int *a, const int *b, int *c, int n, CUdeviceptr d_a,
+                              CUdeviceptr d_b, CUdeviceptr d_c, double ms[3])
+{
+    int block_size;
+    size_t bytes = sizeof(int) * n;
+    void *args[] = { &d_a, &d_b, &d_c, &n };
+    CUresult err = drv.cuDeviceGetAttribute(&block_size, CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_X, device);
+    if (err != CUDA_SUCCESS)
+        return err;
+
+    ms[0] = ms[1] = ms[2] = 1e30;
+    for (int r = -1; r < SMALL_N_ROUNDS; ++r) {     // round -1 warms up
+        startup_clock::time_point t0 = startup_clock::now();
+        if ((err = drv.cuMemcpyHtoD(d_a, a, bytes)) != CUDA_SUCCESS ||
+            (err = drv.cuMemcpyHtoD(d_b, b, bytes)) != CUDA_SUCCESS)
+            return err;
+        double htod = elapsedMs(t0);
+        t0 = startup_clock::now();
+        if ((err = drv.cuLaunchKernel(function, (n + block_size - 1) / block_size, 1, 1,
+                                      block_size, 1, 1, 0, 0, args, 0)) != CUDA_SUCCESS ||
+            (err = drv.cuStreamSynchronize(0)) != CUDA_SUCCESS)
+            return err;
+        double kernel = elapsedMs(t0);
+        t0 = startup_clock::now();
+        if ((err = drv.cuMemcpyDtoH(c, d_c, bytes)) != CUDA_SUCCESS)
+            return err;
+        double dtoh = elapsedMs(t0);
+        if (r >= 0) {
+            ms[0] = std::min(ms[0], htod);
+            ms[1] = std::min(ms[1], kernel);
+            ms[2] = std::min(ms[2], dtoh);
+        }
+    }
+    return CUDA_SUCCESS;
+}
+
+// Best-of-SMALL_N_ROUNDS host add of n elements, in `slices` pool slices.
+inline double timeHostAdd(const int *a, const int *b, int *c, int n, int slices)
+{
+    double best = 1e30;
+    for (int r = -1; r < SMALL_N_ROUNDS; ++r) {
+        startup_clock::time_point t0 = startup_clock::now();
+        hostPool.add(a, b, c, n, slices);
+        double ms = elapsedMs(t0);
+        if (r >= 0)
+            best = std::min(best, ms);
+    }
+    return best;
+}
+
+// Fit the offload model: each phase timed at SMALL_N_FIXED elements, where
+// fixed costs dominate, and at OFFLOAD_PROBE elements, where bandwidth
+// does; the difference between the two gives the bandwidth.
+inline CUresult calibrateOffloadModel()
+{
+    MetricsPause pause;
+    const int small = SMALL_N_FIXED, large = OFFLOAD_PROBE;
+    std::vector<int> a(large, 1), b(large, 2), c(large);
+    CUdeviceptr d_a = 0, d_b = 0, d_c = 0;
+    double s[3], l[3];
+    CUresult err;
+    if ((err = drv.cuMemAlloc(&d_a, sizeof(int) * large)) == CUDA_SUCCESS &&
+        (err = drv.cuMemAlloc(&d_b, sizeof(int) * large)) == CUDA_SUCCESS &&
+        (err = drv.cuMemAlloc(&d_c, sizeof(int) * large)) == CUDA_SUCCESS &&
+        (err = timeDeviceJob(a.data(), b.data(), c.data(), small, d_a, d_b, d_c, s)) == CUDA_SUCCESS)
+        err = timeDeviceJob(a.data(), b.data(), c.data(), large, d_a, d_b, d_c, l);
+    if (d_a)
+        drv.cuMemFree(d_a);
+    if (d_b)
+        drv.cuMemFree(d_b);
+    if (d_c)
+        drv.cuMemFree(d_c);
+    if (err != CUDA_SUCCESS)
+        return err;
+
+    // GB/s from the extra bytes moved by the large job; ms are kept > 0
+    double grow = large - small;
+    OffloadParams p;
+    p.copyMs    = (s[0] / 2 + s[2]) / 2;
+    p.launchMs  = s[1];
+    p.htodGBs   = 8 * grow / (std::max(l[0] - s[0], 1e-6) * 1e6);
+    p.deviceGBs = 12 * grow / (std::max(l[1] - s[1], 1e-6) * 1e6);
+    p.dtohGBs   = 4 * grow / (std::max(l[2] - s[2], 1e-6) * 1e6);
+
+    double single = timeHostAdd(a.data(), b.data(), c.data(), large, 1);
+    p.hostGBs = 12.0 * large / (std::max(single, 1e-6) * 1e6);
+    p.fanoutMs = timeHostAdd(a.data(), b.data(), c.data(), hostPool.threads(), hostPool.threads());
+    double pooled = timeHostAdd(a.data(), b.data(), c.data(), large, hostPool.threads());
+    p.poolGBs = 12.0 * large / (std::max(pooled - p.fanoutMs, 1e-6) * 1e6);
+    if (hostPool.threads() == 1)
+        p.poolGBs = p.hostGBs;
+    offloadModel.setParams(p);
+    return CUDA_SUCCESS;
+}
+
+// Where a job of n elements runs: by the model, or by the fixed threshold
+// VADD_SMALL_N=<n> when that is set. With VADD_COEXEC, a job is split
+// between the two when that is predicted to beat both. Each call counts
+// as one job in the metrics.
+inline OffloadRoute routeJob(int n)
+{
+    OffloadRoute route;
+    if (fixedSmallN)
+        route = n <= smallNThreshold ? ROUTE_HOST : ROUTE_DEVICE;
+    else
+        route = offloadModel.route(n);
+    if (coexec && (!fixedSmallN || route == ROUTE_DEVICE)) {
+        double split = offloadModel.predictSplit(n, coexecSplit.deviceShare(offloadModel, n));
+        if (split < std::min(offloadModel.predictHost(n), offloadModel.predictDevice(n)))
+            route = ROUTE_SPLIT;
+    }
+    metrics.add(route == ROUTE_HOST ? METRIC_JOBS_HOST :
+                route == ROUTE_DEVICE ? METRIC_JOBS_DEVICE : METRIC_JOBS_SPLIT, 1);
+    return route;
+}
+
+// Pool occupancy and the admission queue, sampled on every metrics export.
+inline void registerMetricGauges()
+{
+    metrics.addGauge("vadd_device_pool_reserved_bytes", "Device memory held by the pool.",
+                     [] { return (double)devicePool.reservedBytes(); });
+    metrics.addGauge("vadd_device_pool_in_use_bytes", "Pool blocks handed out.",
+                     [] { return (double)devicePool.inUseBytes(); });
+    metrics.addGauge("vadd_device_pool_cached_bytes", "Pool blocks idle and cached.",
+                     [] { return (double)devicePool.cachedBytes(); });
+    metrics.addGauge("vadd_stream_pool_available", "Idle streams, all priorities.",
+                     [] { return (double)(streamPools[JOB_INTERACTIVE].available() +
+                                          streamPools[JOB_BULK].available()); });
+    metrics.addGauge("vadd_event_pool_available", "Idle events, timed and untimed.",
+                     [] { return (double)(eventPool.available() + timedEventPool.available()); });
+    metrics.addGauge("vadd_admitted_bytes", "Device memory admitted to running jobs.",
+                     [] { return (double)admission.admittedBytes(); });
+    metrics.addGauge("vadd_admission_waiting_jobs", "Jobs waiting for device memory.",
+                     [] { return (double)admission.waitingJobs(); });
+}
+
+// Probe every device and create a context on each of them concurrently;
+// the kernel module is loaded on device 0, which the examples run on.
+// With requireUVA set, device 0 must support unified addressing. Returns
+// false after reporting the error; nothing in here exits the process, so
+// that it can run on initThread.
+inline bool tryInitCUDA(bool requireUVA)
+{
+    int deviceCount = 0;
+    startup_clock::time_point t0 = startup_clock::now();
+    loadCudaDriver();
+    const char *tracePath = getenv("VADD_TRACE");
+    if (tracePath && !driverTrace.active() && !startTrace(tracePath))
+        fprintf(stderr, "Warning: cannot write driver trace to %s\n", tracePath);
+    bool exportMetrics = startMetricsFromEnv();
+    CUresult err = drv.cuInit(0);
+    startupProfile.cuInit = elapsedMs(t0);
+
+    if (err == CUDA_SUCCESS)
+        err = drv.cuDeviceGetCount(&deviceCount);
+
+    if (err != CUDA_SUCCESS || deviceCount == 0) {
+        fprintf(stderr, "Error: no devices supporting CUDA\n");
+        return false;
+    }
+
+    devices.resize(deviceCount);
+    std::vector<std::thread> probes;
+    for (int i = 0; i < deviceCount; ++i)
+        probes.push_back(std::thread(probeDevice, &devices[i], i));
+    for (size_t i = 0; i < probes.size(); ++i)
+        probes[i].join();
+
+    startupProfile.probe = startupProfile.context = 0;
+    for (int i = 0; i < deviceCount; ++i) {
+        if (devices[i].probeMs > startupProfile.probe)
+            startupProfile.probe = devices[i].probeMs;
+        if (devices[i].contextMs > startupProfile.context)
+            startupProfile.context = devices[i].contextMs;
+        if (devices[i].status != CUDA_SUCCESS) {
+            fprintf(stderr, "* Error initializing device %d (error %04d)\n",
+                    i, devices[i].status);
+            if (i == 0)
+                goto exit;
+            continue;
+        }
+        printDeviceInfo(i, devices[i]);
+    }
+
+    device = devices[0].device;
+    context = devices[0].context.get();
+    totalGlobalMem = devices[0].totalGlobalMem;
+    printf("> Using device 0: %s\n", devices[0].name);
+    roofline.init(devices[0].memoryClockKHz, devices[0].busWidthBits,
+                  devices[0].pciBusId[0] ? devices[0].pciBusId : NULL);
+    roofline.printPeaks();
+
+    if (requireUVA && !devices[0].hasUVA) {
+        fprintf(stderr, "Unified Virtual Addressing is not supported on this device\n");
+        goto exit;
+    }
+
+    // the contexts were made current on the probing threads
+    err = drv.cuCtxSetCurrent(context);
+    if (err != CUDA_SUCCESS) {
+        fprintf(stderr, "* Error making the context current (error %04d)\n", err);
+        goto exit;
+    }
+
+    t0 = startup_clock::now();
+    err = module.load(module_file);
+    if (err != CUDA_SUCCESS) {
+        fprintf(stderr, "* Error loading the module %s\n", module_file);
+        goto exit;
+    }
+
+    err = module.getFunction(&function, kernel_name);
+    startupProfile.module = elapsedMs(t0);
+
+    if (err != CUDA_SUCCESS) {
+        fprintf(stderr, "* Error getting kernel function %s\n", kernel_name);
+        goto exit;
+    }
+
+    // keep event and stream creation off the hot path
+    int leastPriority, greatestPriority;
+    err = drv.cuCtxGetStreamPriorityRange(&leastPriority, &greatestPriority);
+    if (err != CUDA_SUCCESS) {
+        fprintf(stderr, "* Error reading the stream priority range (error %04d)\n", err);
+        goto exit;
+    }
+    printf("  Stream priorities:               %d (bulk) .. %d (interactive)\n",
+           leastPriority, greatestPriority);
+    streamPools[JOB_INTERACTIVE].setPriority(greatestPriority);
+    streamPools[JOB_BULK].setPriority(leastPriority);
+
+    if (eventPool.reserve(EVENT_POOL_SIZE) != CUDA_SUCCESS ||
+        streamPools[JOB_INTERACTIVE].reserve(STREAM_POOL_SIZE) != CUDA_SUCCESS ||
+        streamPools[JOB_BULK].reserve(STREAM_POOL_SIZE) != CUDA_SUCCESS) {
+        fprintf(stderr, "* Error creating the event and stream pools\n");
+        goto exit;
+    }
+
+    err = admission.init(&devicePool, ADMISSION_HEADROOM);
+    if (err != CUDA_SUCCESS) {
+        fprintf(stderr, "* Error sizing the admission budget (error %04d)\n", err);
+        goto exit;
+    }
+    printf("  Admission budget:                %llu bytes\n",
+           (unsigned long long)admission.capacityBytes());
+
+    hostPool.start((int)std::max(1u, std::thread::hardware_concurrency()));
+    roofline.setHostThreads(hostPool.threads());
+    err = calibrateOffloadModel();
+    if (err != CUDA_SUCCESS) {
+        fprintf(stderr, "* Error calibrating the offload model (error %04d)\n", err);
+        goto exit;
+    }
+    offloadModel.print();
+    if (getenv("VADD_SMALL_N")) {
+        fixedSmallN = true;
+        smallNThreshold = atoi(getenv("VADD_SMALL_N"));
+        printf("  Small-N host threshold:          %d elements (VADD_SMALL_N)\n", smallNThreshold);
+    } else {
+        smallNThreshold = (int)std::min(offloadModel.crossover(), (long long)INT_MAX);
+        printf("  Small-N host threshold:          %d elements (model crossover)\n", smallNThreshold);
+    }
+
+    coexec = getenv("VADD_COEXEC") && atoi(getenv("VADD_COEXEC")) != 0;
+    coexecState = getenv("VADD_COEXEC_STATE");
+    if (coexec && coexecState && coexecSplit.load(coexecState))
+        printf("  Co-execution device share:       %.3f (from %s)\n",
+               coexecSplit.deviceShare(offloadModel, 0), coexecState);
+
+    if (exportMetrics)
+        registerMetricGauges();
+
+    printStartupProfile();
+    return true;
+exit:
+    module.reset();
+    devices.clear();
+    context = NULL;
+    return false;
+}
+
+inline void initCUDA(bool requireUVA = false)
+{
+    if (!tryInitCUDA(requireUVA))
+        exit(-1);
+}
+
+// --- example inputs ------------------------------------------------------
+#define INPUT_A_RANGE (1 << 30)
+#define INPUT_B_ROOT  32768
+
+// a[i] = n - i and b[i] = i * i, kept below 2^30 each so that neither
+// they nor a[i] + b[i] overflow an int at any n.
+inline int inputA(int i, int n) { return (n - i) % INPUT_A_RANGE; }
+inline int inputB(int i)        { int k = i % INPUT_B_ROOT; return k * k; }
+
+// --- tracked allocations -------------------------------------------------
+// Device memory from devicePool and pinned host memory, recorded in
+// memoryLedger under a purpose and a job id.
+inline CUresult allocDevice(CUdeviceptr *ptr, size_t bytes, const char *purpose, int job = 0)
+{
+    CUresult err = devicePool.allocate(ptr, bytes);
+    if (err == CUDA_SUCCESS)
+        memoryLedger.recordAlloc(MEM_DEVICE, (const void*)*ptr, bytes,
+                                 DeviceMemoryPool::blockSize(bytes), purpose, job);
+    return err;
+}
+
+inline CUresult freeDevice(CUdeviceptr ptr)
+{
+    memoryLedger.recordFree(MEM_DEVICE, (const void*)ptr);
+    return devicePool.free(ptr);
+}
+
+inline CUresult allocPinned(void **ptr, size_t bytes, const char *purpose, int job = 0)
+{
+    CUresult err = drv.cuMemAllocHost(ptr, bytes);
+    if (err == CUDA_SUCCESS)
+        memoryLedger.recordAlloc(MEM_PINNED, *ptr, bytes, bytes, purpose, job);
+    return err;
+}
+
+inline CUresult freePinned(void *ptr)
+{
+    memoryLedger.recordFree(MEM_PINNED, ptr);
+    return drv.cuMemFreeHost(ptr);
+}
+
+inline void printMemoryReport()
+{
+    memoryLedger.print(devicePool.reservedBytes(), devicePool.cachedBytes());
+}
+
+// Run initCUDA() on a background thread so that cuInit, context creation and
+// module load overlap with host-side input preparation.
+// A failure is only recorded there; joinInitCUDA() exits on the main
+// thread once initThread is joined, since exit() with a joinable global
+// std::thread would end in std::terminate.
+inline void beginInitCUDA(bool requireUVA = false)
+{
+    initFailed = false;
+    initThread = std::thread([requireUVA] { initFailed = !tryInitCUDA(requireUVA); });
+}
+
+// Join point before the first allocation. The context was created on another
+// thread, so make it current on the calling thread as well.
+inline void joinInitCUDA()
+{
+    initThread.join();
+    if (initFailed)
+        exit(-1);
+    checkCudaErrors( drv.cuCtxSetCurrent(context) );
+}
+
+inline void finalizeCUDA()
+{
+    printMemoryReport();
+    drv.cuCtxSetCurrent(context);
+    eventPool.clear();
+    timedEventPool.clear();
+    for (int p = 0; p < JOB_PRIORITIES; ++p)
+        streamPools[p].clear();
+    devicePool.trim();
+    metricsRelease();
+    if (coexec && coexecState && !coexecSplit.save(coexecState))
+        fprintf(stderr, "Warning: cannot write the co-execution share to %s\n", coexecState);
+    hostPool.stop();
+    module.reset();
+    devices.clear();
+    context = NULL;
+}
+
+#endif // CUDA_HELPER_H
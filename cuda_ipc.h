@@ -0,0 +1,46 @@
+/*
+ * Sharing device buffers between processes with CUDA IPC handles.
+ *
+ * The producer exports a buffer with exportDeviceBuffer() and sends the
+ * resulting SharedBuffer (plain bytes, safe to write to a pipe or file) to
+ * each consumer, which maps the same device memory with
+ * importDeviceBuffer(). Nothing is copied.
+ *
+ * The buffer must be the base of a cuMemAlloc allocation, which every
+ * block of DeviceMemoryPool is. The producer must keep it allocated, and
+ * not return it to the pool, until every consumer has called
+ * closeDeviceBuffer(). The data must be complete (stream synchronised)
+ * before the handle is sent.
+ */
+
+#ifndef CUDA_IPC_H
+#define CUDA_IPC_H
+
+#include <cuda.h>
+
+#include "cuda_driver.h"
+
+struct SharedBuffer {
+    CUipcMemHandle     handle;
+    unsigned long long bytes;
+};
+
+inline CUresult exportDeviceBuffer(CUdeviceptr ptr, size_t bytes, SharedBuffer *shared)
+{
+    shared->bytes = bytes;
+    return drv.cuIpcGetMemHandle(&shared->handle, ptr);
+}
+
+// Maps the buffer into the current context. Peer access is enabled lazily
+// if the producer's device is not the current one.
+inline CUresult importDeviceBuffer(const SharedBuffer &shared, CUdeviceptr *ptr)
+{
+    return drv.cuIpcOpenMemHandle(ptr, shared.handle, CU_IPC_MEM_LAZY_ENABLE_PEER_ACCESS);
+}
+
+inline CUresult closeDeviceBuffer(CUdeviceptr ptr)
+{
+    return drv.cuIpcCloseMemHandle(ptr);
+}
+
+#endif // CUDA_IPC_H
@@ -0,0 +1,226 @@
+/*
+ * Device memory pool and admission control.
+ *
+ * DeviceMemoryPool caches freed blocks by size class so that repeated jobs
+ * do not go back to cuMemAlloc/cuMemFree, and keeps count of what it holds
+ * from the driver and what is handed out.
+ *
+ * AdmissionController decides whether a job's device memory may be
+ * reserved now. Jobs that fit the remaining budget are admitted, jobs that
+ * fit the total budget but not the remainder wait (backpressure on the
+ * producer) and jobs larger than the whole budget are refused so that the
+ * caller splits them, see chunkElements().
+ */
+
+#ifndef CUDA_MEMORY_H
+#define CUDA_MEMORY_H
+
+#include <stdlib.h>
+#include <cuda.h>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "cuda_driver.h"
+
+// --- device memory pool --------------------------------------------------
+class DeviceMemoryPool {
+public:
+    DeviceMemoryPool() : reserved(0), inUse(0) {}
+
+    DeviceMemoryPool(const DeviceMemoryPool &) = delete;
+    DeviceMemoryPool &operator=(const DeviceMemoryPool &) = delete;
+
+    // Size class of a request: powers of two up to 1 MiB, whole 2 MiB pages
+    // above, which matches the driver's own allocation granularity.
+    static size_t blockSize(size_t bytes)
+    {
+        const size_t smallLimit = (size_t)1 << 20;
+        const size_t page = (size_t)2 << 20;
+        if (bytes > smallLimit)
+            return (bytes + page - 1) / page * page;
+        size_t size = 512;
+        while (size < bytes)
+            size <<= 1;
+        return size;
+    }
+
+    CUresult allocate(CUdeviceptr *ptr, size_t bytes)
+    {
+        size_t size = blockSize(bytes);
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::map<size_t, std::vector<CUdeviceptr> >::iterator it = cached.find(size);
+        if (it != cached.end() && !it->second.empty()) {
+            *ptr = it->second.back();
+            it->second.pop_back();
+        } else {
+            CUresult err = drv.cuMemAlloc(ptr, size);
+            if (err == CUDA_ERROR_OUT_OF_MEMORY) {
+                // cached blocks of other sizes may be what is in the way
+                trimLocked();
+                err = drv.cuMemAlloc(ptr, size);
+            }
+            if (err != CUDA_SUCCESS)
+                return err;
+            reserved += size;
+        }
+        live[*ptr] = size;
+        inUse += size;
+        return CUDA_SUCCESS;
+    }
+
+    CUresult free(CUdeviceptr ptr)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unordered_map<CUdeviceptr, size_t>::iterator it = live.find(ptr);
+        if (it == live.end())
+            return CUDA_ERROR_INVALID_VALUE;
+        cached[it->second].push_back(ptr);
+        inUse -= it->second;
+        live.erase(it);
+        return CUDA_SUCCESS;
+    }
+
+    // Return every cached block to the driver.
+    void trim()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        trimLocked();
+    }
+
+    size_t reservedBytes() const { std::lock_guard<std::mutex> lock(mutex); return reserved; }
+    size_t inUseBytes() const    { std::lock_guard<std::mutex> lock(mutex); return inUse; }
+    size_t cachedBytes() const   { std::lock_guard<std::mutex> lock(mutex); return reserved - inUse; }
+
+private:
+    void trimLocked()
+    {
+        std::map<size_t, std::vector<CUdeviceptr> >::iterator it;
+        for (it = cached.begin(); it != cached.end(); ++it) {
+            for (size_t i = 0; i < it->second.size(); ++i)
+                drv.cuMemFree(it->second[i]);
+            reserved -= it->first * it->second.size();
+        }
+        cached.clear();
+    }
+
+    mutable std::mutex                          mutex;
+    std::map<size_t, std::vector<CUdeviceptr> > cached;
+    std::unordered_map<CUdeviceptr, size_t>     live;
+    size_t                                      reserved;
+    size_t                                      inUse;
+};
+
+// --- admission control ---------------------------------------------------
+class AdmissionController {
+public:
+    AdmissionController() : pool(NULL), capacity(0), admitted(0), waiting(0) {}
+
+    // The budget is the device memory free now, less a headroom fraction
+    // left to the driver and other processes. VADD_DEVICE_MEMORY_LIMIT
+    // (bytes) caps it further, e.g. to exercise splitting on a large GPU.
+    CUresult init(DeviceMemoryPool *memoryPool, double headroom)
+    {
+        size_t freeMem, totalMem;
+        CUresult err = drv.cuMemGetInfo(&freeMem, &totalMem);
+        if (err != CUDA_SUCCESS)
+            return err;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        pool = memoryPool;
+        capacity = (size_t)((freeMem + pool->cachedBytes()) * (1.0 - headroom));
+        const char *limit = getenv("VADD_DEVICE_MEMORY_LIMIT");
+        if (limit && strtoull(limit, NULL, 10) > 0 && strtoull(limit, NULL, 10) < capacity)
+            capacity = strtoull(limit, NULL, 10);
+        return CUDA_SUCCESS;
+    }
+
+    // Reserve bytes of device memory for a job, waiting for other jobs to
+    // release theirs if needed. Fails with CUDA_ERROR_OUT_OF_MEMORY when the
+    // job can never fit, or when the device has less free memory than the
+    // budget assumed and there is no admitted job whose release could help.
+    CUresult admit(size_t bytes)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (bytes > capacity)
+            return CUDA_ERROR_OUT_OF_MEMORY;
+
+        ++waiting;
+        for (;;) {
+            if (admitted + bytes <= capacity) {
+                if (deviceHasRoom(bytes))
+                    break;
+                if (admitted == 0) {
+                    --waiting;
+                    return CUDA_ERROR_OUT_OF_MEMORY;
+                }
+            }
+            released.wait(lock);
+        }
+        --waiting;
+        admitted += bytes;
+        return CUDA_SUCCESS;
+    }
+
+    // Non-blocking variant: CUDA_ERROR_NOT_READY if the job has to wait.
+    CUresult tryAdmit(size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (bytes > capacity)
+            return CUDA_ERROR_OUT_OF_MEMORY;
+        if (admitted + bytes > capacity || !deviceHasRoom(bytes))
+            return CUDA_ERROR_NOT_READY;
+        admitted += bytes;
+        return CUDA_SUCCESS;
+    }
+
+    void release(size_t bytes)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            admitted -= bytes;
+        }
+        released.notify_all();
+    }
+
+    // Largest number of elements, at bytesPerElement of device memory each
+    // (all buffers of the job together), that can be admitted at once.
+    size_t chunkElements(size_t n, size_t bytesPerElement) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t fit = capacity / bytesPerElement;
+        // leave room for the pool rounding each buffer up to its size class
+        fit = fit / 2 > 0 ? fit / 2 : 1;
+        return n < fit ? n : fit;
+    }
+
+    size_t capacityBytes() const { std::lock_guard<std::mutex> lock(mutex); return capacity; }
+    size_t admittedBytes() const { std::lock_guard<std::mutex> lock(mutex); return admitted; }
+    int    waitingJobs() const   { std::lock_guard<std::mutex> lock(mutex); return waiting; }
+
+private:
+    // Called with the mutex held. Memory already held by the pool but not
+    // handed out counts as free.
+    bool deviceHasRoom(size_t bytes) const
+    {
+        size_t freeMem, totalMem;
+        if (drv.cuMemGetInfo(&freeMem, &totalMem) != CUDA_SUCCESS)
+            return false;
+        size_t idle = pool ? pool->cachedBytes() : 0;
+        size_t used = pool ? pool->inUseBytes() : 0;
+        size_t unallocated = admitted > used ? admitted - used : 0;
+        return freeMem + idle >= bytes + unallocated;
+    }
+
+    mutable std::mutex      mutex;
+    std::condition_variable released;
+    DeviceMemoryPool       *pool;
+    size_t                  capacity;
+    size_t                  admitted;
+    int                     waiting;
+};
+
+#endif // CUDA_MEMORY_H
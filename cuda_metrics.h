@@ -0,0 +1,549 @@
+/*
+ * Service metrics in Prometheus text format.
+ *
+ * startMetrics() wraps the driver table the way startTrace() does: every
+ * entry point counts the CUresult it fails with, copies count their bytes
+ * per direction, and each launch is counted and bracketed by a pair of
+ * timing events whose elapsed time is added to the kernel time once the
+ * events complete. Jobs are counted where they are routed (routeJob() in
+ * cuda_helper.h), however many launches each takes. Traffic of the
+ * start-up calibration is left out: it runs inside a MetricsPause. Counters live in per-thread shards of relaxed atomics,
+ * so the hot path never shares a cache line with another thread; readers
+ * sum the shards.
+ *
+ * Gauges that belong to other components (pool occupancy, admission queue)
+ * are registered as callbacks with addGauge() and sampled on export.
+ *
+ * The exporter thread renders everything every VADD_METRICS_INTERVAL_MS
+ * (default 1000) and writes it to VADD_METRICS_FILE (replaced atomically),
+ * and/or answers any HTTP request on 127.0.0.1:VADD_METRICS_PORT with it.
+ * startMetricsFromEnv() does nothing unless one of the two is set.
+ *
+ * Kernel time is collected on the launching thread, on its next launch or
+ * stream synchronisation, since the events belong to that thread's
+ * context; metricsCollect() forces it.
+ */
+
+#ifndef CUDA_METRICS_H
+#define CUDA_METRICS_H
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <cuda.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cuda_driver.h"
+
+#define METRICS_INTERVAL_MS  1000
+#define METRICS_ERROR_CODES  1024     // CUresult values are below 1000
+#define METRICS_MAX_PENDING  256      // launches awaiting their timing events
+
+enum MetricCounter {
+    METRIC_JOBS_HOST,
+    METRIC_JOBS_DEVICE,
+    METRIC_JOBS_SPLIT,
+    METRIC_LAUNCHES,
+    METRIC_BYTES_HTOD,
+    METRIC_BYTES_DTOH,
+    METRIC_BYTES_DTOD,
+    METRIC_KERNEL_NS,
+    METRIC_KERNELS_TIMED,
+    METRIC_COUNTERS
+};
+
+// One per thread; only the owner writes, anyone may read.
+struct alignas(64) MetricShard {
+    std::atomic<uint64_t> counters[METRIC_COUNTERS];
+    std::atomic<uint64_t> errors[METRICS_ERROR_CODES];
+    std::atomic<int64_t>  inFlight;             // launches not yet timed
+
+    // owner thread only
+    struct Timing { CUcontext ctx; CUevent start, stop; };
+    std::vector<Timing> pending;
+    std::vector<Timing> spare;                  // completed pairs for reuse
+
+    MetricShard() : inFlight(0)
+    {
+        for (int i = 0; i < METRIC_COUNTERS; ++i)
+            counters[i].store(0, std::memory_order_relaxed);
+        for (int i = 0; i < METRICS_ERROR_CODES; ++i)
+            errors[i].store(0, std::memory_order_relaxed);
+    }
+};
+
+class Metrics {
+public:
+    Metrics() : paused(0), stopping(false), listenFd(-1) { wake[0] = wake[1] = -1; }
+
+    // Calling thread's shard; shards outlive their threads so totals keep
+    // what finished threads counted.
+    MetricShard &shard()
+    {
+        static thread_local MetricShard *mine = NULL;
+        if (!mine) {
+            mine = new MetricShard();
+            std::lock_guard<std::mutex> lock(mutex);
+            shards.push_back(mine);
+        }
+        return *mine;
+    }
+
+    void add(MetricCounter c, uint64_t value)
+    {
+        if (counting())
+            shard().counters[c].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    // False inside a MetricsPause: launches, bytes and kernel time are not
+    // counted, failures still are.
+    bool counting() const { return paused.load(std::memory_order_relaxed) == 0; }
+    void pause()          { paused.fetch_add(1, std::memory_order_relaxed); }
+    void resume()         { paused.fetch_sub(1, std::memory_order_relaxed); }
+
+    CUresult result(CUresult err)
+    {
+        if (err != CUDA_SUCCESS && err != CUDA_ERROR_NOT_READY)
+            shard().errors[(unsigned)err % METRICS_ERROR_CODES].fetch_add(1, std::memory_order_relaxed);
+        return err;
+    }
+
+    // Sampled on every export; name must be a valid Prometheus metric name.
+    void addGauge(const char *name, const char *help, std::function<double()> sample)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Gauge g = { name, help, sample };
+        gauges.push_back(g);
+    }
+
+    std::string render()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t c[METRIC_COUNTERS] = { 0 };
+        int64_t inFlight = 0;
+        for (size_t s = 0; s < shards.size(); ++s) {
+            for (int i = 0; i < METRIC_COUNTERS; ++i)
+                c[i] += shards[s]->counters[i].load(std::memory_order_relaxed);
+            inFlight += shards[s]->inFlight.load(std::memory_order_relaxed);
+        }
+
+        std::string out;
+        char line[256];
+        header(out, "vadd_jobs_total", "Jobs, by where they were routed.", "counter");
+        snprintf(line, sizeof(line),
+                 "vadd_jobs_total{route=\"host\"} %llu\n"
+                 "vadd_jobs_total{route=\"device\"} %llu\n"
+                 "vadd_jobs_total{route=\"split\"} %llu\n",
+                 (unsigned long long)c[METRIC_JOBS_HOST], (unsigned long long)c[METRIC_JOBS_DEVICE],
+                 (unsigned long long)c[METRIC_JOBS_SPLIT]);
+        out += line;
+        header(out, "vadd_kernel_launches_total", "Kernel launches, every chunk and check included.", "counter");
+        snprintf(line, sizeof(line), "vadd_kernel_launches_total %llu\n",
+                 (unsigned long long)c[METRIC_LAUNCHES]);
+        out += line;
+
+        header(out, "vadd_bytes_total", "Bytes copied, by direction.", "counter");
+        snprintf(line, sizeof(line),
+                 "vadd_bytes_total{direction=\"htod\"} %llu\n"
+                 "vadd_bytes_total{direction=\"dtoh\"} %llu\n"
+                 "vadd_bytes_total{direction=\"dtod\"} %llu\n",
+                 (unsigned long long)c[METRIC_BYTES_HTOD], (unsigned long long)c[METRIC_BYTES_DTOH],
+                 (unsigned long long)c[METRIC_BYTES_DTOD]);
+        out += line;
+
+        header(out, "vadd_kernel_seconds_total", "Device time of completed kernels.", "counter");
+        snprintf(line, sizeof(line), "vadd_kernel_seconds_total %.9f\n", c[METRIC_KERNEL_NS] / 1e9);
+        out += line;
+        header(out, "vadd_kernels_timed_total", "Kernels whose device time is included.", "counter");
+        snprintf(line, sizeof(line), "vadd_kernels_timed_total %llu\n",
+                 (unsigned long long)c[METRIC_KERNELS_TIMED]);
+        out += line;
+
+        header(out, "vadd_queue_depth", "Kernels launched and not yet seen to complete.", "gauge");
+        snprintf(line, sizeof(line), "vadd_queue_depth %lld\n", (long long)inFlight);
+        out += line;
+
+        header(out, "vadd_driver_errors_total", "Failed driver calls, by CUresult.", "counter");
+        for (int code = 0; code < METRICS_ERROR_CODES; ++code) {
+            uint64_t n = 0;
+            for (size_t s = 0; s < shards.size(); ++s)
+                n += shards[s]->errors[code].load(std::memory_order_relaxed);
+            if (n) {
+                snprintf(line, sizeof(line), "vadd_driver_errors_total{result=\"%d\"} %llu\n",
+                         code, (unsigned long long)n);
+                out += line;
+            }
+        }
+
+        for (size_t i = 0; i < gauges.size(); ++i) {
+            header(out, gauges[i].name, gauges[i].help, "gauge");
+            snprintf(line, sizeof(line), "%s %.17g\n", gauges[i].name, gauges[i].sample());
+            out += line;
+        }
+        return out;
+    }
+
+    // --- exporter --------------------------------------------------------
+    // path and port are optional (NULL / 0).
+    bool startExporter(const char *path, int port, int intervalMs)
+    {
+        if (exporter.joinable())
+            return false;
+        filePath = path ? path : "";
+        if (port > 0 && (listenFd = listenLocal(port)) < 0)
+            return false;
+        if (pipe(wake) != 0)
+            return false;
+        stopping = false;
+        exporter = std::thread(&Metrics::run, this, intervalMs);
+        return true;
+    }
+
+    // Writes the file one last time.
+    void stopExporter()
+    {
+        if (!exporter.joinable())
+            return;
+        stopping = true;
+        char b = 0;
+        if (write(wake[1], &b, 1) < 0)
+            perror("metrics");
+        exporter.join();
+        close(wake[0]);
+        close(wake[1]);
+        if (listenFd >= 0)
+            close(listenFd);
+        listenFd = -1;
+        if (!filePath.empty())
+            writeFile();
+    }
+
+private:
+    struct Gauge {
+        const char            *name;
+        const char            *help;
+        std::function<double()> sample;
+    };
+
+    static void header(std::string &out, const char *name, const char *help, const char *type)
+    {
+        out += "# HELP ";
+        out += name;
+        out += " ";
+        out += help;
+        out += "\n# TYPE ";
+        out += name;
+        out += " ";
+        out += type;
+        out += "\n";
+    }
+
+    static int listenLocal(int port)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    void writeFile()
+    {
+        std::string tmp = filePath + ".tmp";
+        FILE *f = fopen(tmp.c_str(), "w");
+        if (!f)
+            return;
+        std::string body = render();
+        fwrite(body.data(), 1, body.size(), f);
+        if (fclose(f) == 0)
+            rename(tmp.c_str(), filePath.c_str());
+    }
+
+    // Any request gets the metrics; scrapers only ever GET /metrics.
+    void serve(int fd)
+    {
+        char request[1024];
+        pollfd p = { fd, POLLIN, 0 };
+        if (poll(&p, 1, 100) > 0 && read(fd, request, sizeof(request)) < 0) {
+            close(fd);
+            return;
+        }
+        std::string body = render();
+        char head[128];
+        snprintf(head, sizeof(head),
+                 "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                 "Content-Length: %zu\r\n\r\n", body.size());
+        std::string reply = head + body;
+        for (size_t sent = 0; sent < reply.size(); ) {
+            ssize_t n = write(fd, reply.data() + sent, reply.size() - sent);
+            if (n <= 0)
+                break;
+            sent += n;
+        }
+        close(fd);
+    }
+
+    void run(int intervalMs)
+    {
+        std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+        while (!stopping) {
+            if (!filePath.empty() && std::chrono::steady_clock::now() >= next) {
+                writeFile();
+                next += std::chrono::milliseconds(intervalMs);
+            }
+            int timeout = intervalMs;
+            if (!filePath.empty())
+                timeout = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                    next - std::chrono::steady_clock::now()).count();
+            pollfd fds[2] = { { wake[0], POLLIN, 0 }, { listenFd, POLLIN, 0 } };
+            int ready = poll(fds, listenFd >= 0 ? 2 : 1, timeout > 0 ? timeout : 0);
+            if (ready < 0 && errno != EINTR)
+                break;
+            if (ready > 0 && listenFd >= 0 && (fds[1].revents & POLLIN)) {
+                int client = accept(listenFd, NULL, NULL);
+                if (client >= 0)
+                    serve(client);
+            }
+        }
+    }
+
+    std::mutex                mutex;
+    std::vector<MetricShard*> shards;
+    std::vector<Gauge>        gauges;
+
+    std::thread               exporter;
+    std::atomic<int>          paused;
+    std::atomic<bool>         stopping;
+    std::string               filePath;
+    int                       listenFd;
+    int                       wake[2];      // self-pipe to interrupt poll()
+};
+
+Metrics    metrics;
+CudaDriver metricsReal;     // the table behind the metrics wrappers
+
+// Keeps work that is not service traffic, such as the start-up
+// calibration, out of the counters for the lifetime of the scope. The
+// pause is process-wide.
+class MetricsPause {
+public:
+    MetricsPause()  { metrics.pause(); }
+    ~MetricsPause() { metrics.resume(); }
+
+    MetricsPause(const MetricsPause &) = delete;
+    MetricsPause &operator=(const MetricsPause &) = delete;
+};
+
+// --- kernel timing -------------------------------------------------------
+// Add the time of every completed launch of the calling thread.
+inline void metricsCollect()
+{
+    MetricShard &s = metrics.shard();
+    size_t kept = 0;
+    for (size_t i = 0; i < s.pending.size(); ++i) {
+        MetricShard::Timing &t = s.pending[i];
+        CUresult err = metricsReal.cuEventQuery(t.stop);
+        if (err == CUDA_ERROR_NOT_READY) {
+            s.pending[kept++] = t;
+            continue;
+        }
+        float ms;
+        if (err == CUDA_SUCCESS && metricsReal.cuEventElapsedTime(&ms, t.start, t.stop) == CUDA_SUCCESS) {
+            s.counters[METRIC_KERNEL_NS].fetch_add((uint64_t)(ms * 1e6), std::memory_order_relaxed);
+            s.counters[METRIC_KERNELS_TIMED].fetch_add(1, std::memory_order_relaxed);
+            s.spare.push_back(t);
+        }
+        // otherwise the context is gone and so are the events
+        s.inFlight.fetch_sub(1, std::memory_order_relaxed);
+    }
+    s.pending.resize(kept);
+}
+
+// A pair of timing events of the current context, recycled when possible.
+inline bool metricsTiming(MetricShard &s, MetricShard::Timing *t)
+{
+    if (metricsReal.cuCtxGetCurrent(&t->ctx) != CUDA_SUCCESS)
+        return false;
+    for (size_t i = 0; i < s.spare.size(); ++i) {
+        if (s.spare[i].ctx == t->ctx) {
+            *t = s.spare[i];
+            s.spare.erase(s.spare.begin() + i);
+            return true;
+        }
+    }
+    if (metricsReal.cuEventCreate(&t->start, CU_EVENT_DEFAULT) != CUDA_SUCCESS)
+        return false;
+    if (metricsReal.cuEventCreate(&t->stop, CU_EVENT_DEFAULT) != CUDA_SUCCESS) {
+        metricsReal.cuEventDestroy(t->start);
+        return false;
+    }
+    return true;
+}
+
+// --- wrappers ------------------------------------------------------------
+inline CUresult metricsMemcpyHtoD(CUdeviceptr dst, const void *src, size_t bytes)
+{
+    metrics.add(METRIC_BYTES_HTOD, bytes);
+    return metrics.result(metricsReal.cuMemcpyHtoD(dst, src, bytes));
+}
+
+inline CUresult metricsMemcpyDtoH(void *dst, CUdeviceptr src, size_t bytes)
+{
+    metrics.add(METRIC_BYTES_DTOH, bytes);
+    return metrics.result(metricsReal.cuMemcpyDtoH(dst, src, bytes));
+}
+
+inline CUresult metricsMemcpyHtoDAsync(CUdeviceptr dst, const void *src, size_t bytes, CUstream stream)
+{
+    metrics.add(METRIC_BYTES_HTOD, bytes);
+    return metrics.result(metricsReal.cuMemcpyHtoDAsync(dst, src, bytes, stream));
+}
+
+inline CUresult metricsMemcpyDtoHAsync(void *dst, CUdeviceptr src, size_t bytes, CUstream stream)
+{
+    metrics.add(METRIC_BYTES_DTOH, bytes);
+    return metrics.result(metricsReal.cuMemcpyDtoHAsync(dst, src, bytes, stream));
+}
+
+inline CUresult metricsMemcpyPeerAsync(CUdeviceptr dst, CUcontext dstCtx, CUdeviceptr src, CUcontext srcCtx,
+                                       size_t bytes, CUstream stream)
+{
+    metrics.add(METRIC_BYTES_DTOD, bytes);
+    return metrics.result(metricsReal.cuMemcpyPeerAsync(dst, dstCtx, src, srcCtx, bytes, stream));
+}
+
+inline CUresult metricsLaunchKernel(CUfunction f,
+                                    unsigned int gridDimX, unsigned int gridDimY, unsigned int gridDimZ,
+                                    unsigned int blockDimX, unsigned int blockDimY, unsigned int blockDimZ,
+                                    unsigned int sharedMemBytes, CUstream hStream,
+                                    void **kernelParams, void **extra)
+{
+    if (!metrics.counting())
+        return metrics.result(metricsReal.cuLaunchKernel(f, gridDimX, gridDimY, gridDimZ,
+                                                         blockDimX, blockDimY, blockDimZ,
+                                                         sharedMemBytes, hStream, kernelParams, extra));
+    MetricShard &s = metrics.shard();
+    metricsCollect();
+    s.counters[METRIC_LAUNCHES].fetch_add(1, std::memory_order_relaxed);
+
+    MetricShard::Timing t;
+    bool timed = s.pending.size() < METRICS_MAX_PENDING && metricsTiming(s, &t) &&
+                 metricsReal.cuEventRecord(t.start, hStream) == CUDA_SUCCESS;
+    CUresult err = metricsReal.cuLaunchKernel(f, gridDimX, gridDimY, gridDimZ,
+                                              blockDimX, blockDimY, blockDimZ,
+                                              sharedMemBytes, hStream, kernelParams, extra);
+    if (timed && err == CUDA_SUCCESS && metricsReal.cuEventRecord(t.stop, hStream) == CUDA_SUCCESS) {
+        s.pending.push_back(t);
+        s.inFlight.fetch_add(1, std::memory_order_relaxed);
+    } else if (timed) {
+        s.spare.push_back(t);
+    }
+    return metrics.result(err);
+}
+
+inline CUresult metricsStreamSynchronize(CUstream hStream)
+{
+    CUresult err = metricsReal.cuStreamSynchronize(hStream);
+    metricsCollect();
+    return metrics.result(err);
+}
+
+// Count the failures of every entry point, then route the ones with more
+// to measure through their own wrappers. Must run after the backend (and
+// any trace) is installed.
+inline void startMetrics()
+{
+    metricsReal = drv;
+#define X(fn) \
+    drv.fn = [](auto... args) { return metrics.result(metricsReal.fn(args...)); };
+    CUDA_DRIVER_ENTRY_POINTS(X)
+#undef X
+    drv.cuMemcpyHtoD        = metricsMemcpyHtoD;
+    drv.cuMemcpyDtoH        = metricsMemcpyDtoH;
+    drv.cuMemcpyHtoDAsync   = metricsMemcpyHtoDAsync;
+    drv.cuMemcpyDtoHAsync   = metricsMemcpyDtoHAsync;
+    drv.cuMemcpyPeerAsync   = metricsMemcpyPeerAsync;
+    drv.cuLaunchKernel      = metricsLaunchKernel;
+    drv.cuStreamSynchronize = metricsStreamSynchronize;
+}
+
+// Before the contexts are destroyed: wait for the calling thread's
+// launches still being timed, add their time, and destroy all its events,
+// so that none outlives its context or is queried after it is gone.
+inline void metricsRelease()
+{
+    if (!metricsReal.cuInit)
+        return;
+    MetricShard &s = metrics.shard();
+    for (size_t i = 0; i < s.pending.size(); ++i)
+        metricsReal.cuEventSynchronize(s.pending[i].stop);
+    metricsCollect();
+    // whatever is left failed to complete; it is not timed
+    for (size_t i = 0; i < s.pending.size(); ++i) {
+        metricsReal.cuEventDestroy(s.pending[i].start);
+        metricsReal.cuEventDestroy(s.pending[i].stop);
+        s.inFlight.fetch_sub(1, std::memory_order_relaxed);
+    }
+    s.pending.clear();
+    for (size_t i = 0; i < s.spare.size(); ++i) {
+        metricsReal.cuEventDestroy(s.spare[i].start);
+        metricsReal.cuEventDestroy(s.spare[i].stop);
+    }
+    s.spare.clear();
+}
+
+inline void stopMetrics()
+{
+    metricsCollect();
+    metrics.stopExporter();
+}
+
+inline bool metricsStarted()
+{
+    return metricsReal.cuInit != NULL;
+}
+
+// Wrap the driver and start exporting if VADD_METRICS_FILE or
+// VADD_METRICS_PORT is set. Returns whether metrics are on.
+inline bool startMetricsFromEnv()
+{
+    const char *path = getenv("VADD_METRICS_FILE");
+    const char *port = getenv("VADD_METRICS_PORT");
+    const char *interval = getenv("VADD_METRICS_INTERVAL_MS");
+    if ((!path && !port) || metricsStarted())
+        return false;
+
+    int ms = interval ? atoi(interval) : METRICS_INTERVAL_MS;
+    if (!metrics.startExporter(path, port ? atoi(port) : 0, ms > 0 ? ms : METRICS_INTERVAL_MS)) {
+        fprintf(stderr, "Warning: cannot start the metrics exporter\n");
+        return false;
+    }
+    startMetrics();
+    atexit(stopMetrics);
+    return true;
+}
+
+#endif // CUDA_METRICS_H
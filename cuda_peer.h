@@ -0,0 +1,167 @@
+/*
+ * Device-to-device copies across GPUs.
+ *
+ * PeerTopology records which device pairs can access each other's memory
+ * (cuDeviceCanAccessPeer) and enables peer access for them. copyPeer()
+ * then moves a buffer between devices with cuMemcpyPeerAsync when the pair
+ * is connected, and stages it through pinned host memory otherwise.
+ *
+ * VADD_PEER_TOPOLOGY overrides what the driver reports, to exercise both
+ * paths on any machine: "none" disables every link, "all" enables every
+ * link, and a list such as "0-1,2-3" enables exactly those pairs (both
+ * directions).
+ */
+
+#ifndef CUDA_PEER_H
+#define CUDA_PEER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cuda.h>
+#include <vector>
+
+#include "cuda_driver.h"
+
+// Size of the pinned bounce buffer used when peer access is unavailable.
+#define PEER_STAGING_BYTES (4 << 20)
+
+class PeerTopology {
+public:
+    // contexts[i] is the context of device i.
+    CUresult init(const std::vector<CUdevice> &devs, const std::vector<CUcontext> &ctxs)
+    {
+        devices = devs;
+        contexts = ctxs;
+        size_t count = devices.size();
+        access.assign(count * count, 0);
+
+        for (size_t i = 0; i < count; ++i) {
+            for (size_t j = 0; j < count; ++j) {
+                if (i == j)
+                    continue;
+                int can = 0;
+                CUresult err = drv.cuDeviceCanAccessPeer(&can, devices[i], devices[j]);
+                if (err != CUDA_SUCCESS)
+                    return err;
+                access[i * count + j] = can;
+            }
+        }
+        applyOverride(getenv("VADD_PEER_TOPOLOGY"));
+        return enable();
+    }
+
+    bool canAccess(int from, int to) const
+    {
+        return from == to || access[from * devices.size() + to];
+    }
+
+    void print() const
+    {
+        size_t count = devices.size();
+        printf("> Peer access:\n");
+        for (size_t i = 0; i < count; ++i) {
+            printf("  device %zu ->", i);
+            for (size_t j = 0; j < count; ++j)
+                printf(" %c", i == j ? '-' : (access[i * count + j] ? 'Y' : 'n'));
+            printf("\n");
+        }
+    }
+
+    // Copy bytes from device src to device dst. The source data must be
+    // complete, e.g. its stream synchronised. The peer path is queued on
+    // stream, which must belong to the destination context; the staged
+    // path is synchronous.
+    CUresult copyPeer(CUdeviceptr dstPtr, int dst, CUdeviceptr srcPtr, int src,
+                      size_t bytes, CUstream stream)
+    {
+        if (canAccess(dst, src) && canAccess(src, dst))
+            return drv.cuMemcpyPeerAsync(dstPtr, contexts[dst], srcPtr, contexts[src],
+                                         bytes, stream);
+        return copyStaged(dstPtr, dst, srcPtr, src, bytes);
+    }
+
+private:
+    void applyOverride(const char *spec)
+    {
+        if (!spec)
+            return;
+        size_t count = devices.size();
+        if (strcmp(spec, "all") == 0) {
+            access.assign(count * count, 1);
+            return;
+        }
+        access.assign(count * count, 0);
+        if (strcmp(spec, "none") == 0)
+            return;
+
+        // "i-j[,i-j...]"
+        const char *p = spec;
+        while (*p) {
+            char *end;
+            long i = strtol(p, &end, 10);
+            if (*end != '-')
+                break;
+            long j = strtol(end + 1, &end, 10);
+            if (i >= 0 && j >= 0 && (size_t)i < count && (size_t)j < count) {
+                access[i * count + j] = 1;
+                access[j * count + i] = 1;
+            }
+            if (*end != ',')
+                break;
+            p = end + 1;
+        }
+    }
+
+    CUresult enable()
+    {
+        size_t count = devices.size();
+        for (size_t i = 0; i < count; ++i) {
+            for (size_t j = 0; j < count; ++j) {
+                if (i == j || !access[i * count + j])
+                    continue;
+                CUresult err = drv.cuCtxSetCurrent(contexts[i]);
+                if (err == CUDA_SUCCESS)
+                    err = drv.cuCtxEnablePeerAccess(contexts[j], 0);
+                if (err == CUDA_ERROR_PEER_ACCESS_ALREADY_ENABLED)
+                    err = CUDA_SUCCESS;
+                if (err != CUDA_SUCCESS) {
+                    // the link exists on paper only; use the staged path
+                    access[i * count + j] = 0;
+                }
+            }
+        }
+        return count ? drv.cuCtxSetCurrent(contexts[0]) : CUDA_SUCCESS;
+    }
+
+    // Bounce through a pinned buffer in PEER_STAGING_BYTES pieces.
+    CUresult copyStaged(CUdeviceptr dstPtr, int dst, CUdeviceptr srcPtr, int src, size_t bytes)
+    {
+        CUcontext current;
+        void *staging;
+        CUresult err = drv.cuCtxGetCurrent(&current);
+        if (err == CUDA_SUCCESS)
+            err = drv.cuMemAllocHost(&staging, PEER_STAGING_BYTES);
+        if (err != CUDA_SUCCESS)
+            return err;
+
+        for (size_t done = 0; done < bytes && err == CUDA_SUCCESS; done += PEER_STAGING_BYTES) {
+            size_t piece = (bytes - done < PEER_STAGING_BYTES) ? bytes - done : PEER_STAGING_BYTES;
+            if ((err = drv.cuCtxSetCurrent(contexts[src])) != CUDA_SUCCESS ||
+                (err = drv.cuMemcpyDtoH(staging, srcPtr + done, piece)) != CUDA_SUCCESS ||
+                (err = drv.cuCtxSetCurrent(contexts[dst])) != CUDA_SUCCESS)
+                break;
+            err = drv.cuMemcpyHtoD(dstPtr + done, staging, piece);
+        }
+
+        drv.cuMemFreeHost(staging);
+        drv.cuCtxSetCurrent(current);
+        return err;
+    }
+
+    std::vector<CUdevice>  devices;
+    std::vector<CUcontext> contexts;
+    std::vector<int>       access;     // access[i * count + j]: i can read j
+};
+
+#endif // CUDA_PEER_H
@@ -0,0 +1,137 @@
+/*
+ * Recycled pools of events and streams.
+ *
+ * Creating and destroying a CUevent or CUstream per job costs microseconds
+ * and takes driver locks. The pools pre-create handles at start-up, hand
+ * them out with acquire() and take them back with release(); when a pool
+ * runs dry it grows by another batch instead of failing. Creation happens
+ * in the context current on the calling thread.
+ */
+
+#ifndef CUDA_POOL_H
+#define CUDA_POOL_H
+
+#include <cuda.h>
+#include <mutex>
+#include <vector>
+
+#include "cuda_driver.h"
+
+template <typename Handle>
+class HandlePool {
+public:
+    explicit HandlePool(unsigned int flags) : flags(flags), created(0) {}
+    virtual ~HandlePool() {}
+
+    HandlePool(const HandlePool &) = delete;
+    HandlePool &operator=(const HandlePool &) = delete;
+
+    // Make sure at least count handles are idle in the pool.
+    CUresult reserve(size_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return grow(count);
+    }
+
+    CUresult acquire(Handle *handle)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (idle.empty()) {
+            CUresult err = grow(created ? created : 1);
+            if (err != CUDA_SUCCESS)
+                return err;
+        }
+        *handle = idle.back();
+        idle.pop_back();
+        return CUDA_SUCCESS;
+    }
+
+    void release(Handle handle)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.push_back(handle);
+    }
+
+    // Destroy the idle handles; anything still acquired is leaked to the
+    // caller. Call before the owning context goes away.
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < idle.size(); ++i)
+            destroy(idle[i]);
+        created -= idle.size();
+        idle.clear();
+    }
+
+    size_t size() const      { std::lock_guard<std::mutex> lock(mutex); return created; }
+    size_t available() const { std::lock_guard<std::mutex> lock(mutex); return idle.size(); }
+
+protected:
+    virtual CUresult create(Handle *handle) = 0;
+    virtual void     destroy(Handle handle) = 0;
+
+    const unsigned int flags;
+
+private:
+    // Called with the mutex held.
+    CUresult grow(size_t count)
+    {
+        while (idle.size() < count) {
+            Handle h;
+            CUresult err = create(&h);
+            if (err != CUDA_SUCCESS)
+                return err;
+            idle.push_back(h);
+            ++created;
+        }
+        return CUDA_SUCCESS;
+    }
+
+    mutable std::mutex  mutex;
+    std::vector<Handle> idle;
+    size_t              created;
+};
+
+// Events are created without timing unless the pool is asked for it, which
+// makes record and query cheaper.
+class EventPool : public HandlePool<CUevent> {
+public:
+    explicit EventPool(bool timing = false)
+        : HandlePool<CUevent>(timing ? CU_EVENT_DEFAULT : CU_EVENT_DISABLE_TIMING) {}
+
+protected:
+    CUresult create(CUevent *event) override { return drv.cuEventCreate(event, flags); }
+    void     destroy(CUevent event) override { drv.cuEventDestroy(event); }
+};
+
+// Non-blocking streams, so pooled work never serialises with the null stream.
+// All streams of a pool share one scheduling priority; it only applies to
+// streams created after setPriority().
+class StreamPool : public HandlePool<CUstream> {
+public:
+    StreamPool() : HandlePool<CUstream>(CU_STREAM_NON_BLOCKING), priority(0) {}
+
+    void setPriority(int p) { priority = p; }
+    int  getPriority() const { return priority; }
+
+protected:
+    CUresult create(CUstream *stream) override
+    {
+        return drv.cuStreamCreateWithPriority(stream, flags, priority);
+    }
+    void     destroy(CUstream stream) override { drv.cuStreamDestroy(stream); }
+
+private:
+    int priority;
+};
+
+// Job-level priority tag. Interactive jobs run on streams at the device's
+// greatest priority, bulk jobs at its least, so that small latency-bound
+// jobs are scheduled ahead of large ones already queued.
+enum JobPriority {
+    JOB_INTERACTIVE,
+    JOB_BULK,
+    JOB_PRIORITIES
+};
+
+#endif // CUDA_POOL_H
@@ -0,0 +1,223 @@
+/*
+ * Achieved versus theoretical bandwidth, per phase of a job.
+ *
+ * Roofline::init() derives the peaks of the device in use:
+ *   DRAM  2 (double data rate) x memory clock x bus width
+ *   link  PCIe transfer rate x lanes x line-code efficiency, from
+ *         /sys/bus/pci/devices/<bus id>: max_link_speed, since an idle GPU
+ *         trains its link down, and current_link_width
+ * The host peak is what a STREAM-style add (c = a + b over arrays much
+ * larger than the caches) achieves on this machine, measured on first use:
+ * once on one thread, for plain host loops, and once split over as many
+ * threads as the HostAddPool runs (setHostThreads()), for adds spread over
+ * the pool. A single thread rarely saturates the memory bus, so a pooled
+ * add measured against the one-thread figure could pass 100%.
+ *
+ * report() prints the GB/s a phase achieved and what fraction of the
+ * relevant peak that is: near the peak the job is bandwidth-bound, far
+ * below it the time goes into launch, synchronisation or driver overhead.
+ * A peak the backend cannot provide (the CPU fallback has neither DRAM
+ * clock nor PCIe link) falls back to the host STREAM figure, and the phase
+ * is reported as a host phase, since that backend moves everything
+ * through host memory.
+ */
+
+#ifndef CUDA_ROOFLINE_H
+#define CUDA_ROOFLINE_H
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// Elements per STREAM array: 3 x 32 MiB, well past any last-level cache.
+#define STREAM_ELEMENTS (8 << 20)
+#define STREAM_REPEATS  5
+
+enum RooflinePeak {
+    PEAK_DRAM,          // kernels reading and writing device memory
+    PEAK_LINK,          // host <-> device copies
+    PEAK_HOST,          // host-side loops on one thread
+    PEAK_HOST_POOL      // host-side adds spread over the HostAddPool
+};
+
+class Roofline {
+public:
+    Roofline() : dramGBs(0), linkGBs(0), linkGTs(0), linkWidth(0), hostGBs(0),
+                 hostThreads(1), hostPoolGBs(0) {}
+
+    // memoryClockKHz and busWidthBits as reported by cuDeviceGetAttribute;
+    // pciBusId may be NULL when the backend has no bus.
+    void init(int memoryClockKHz, int busWidthBits, const char *pciBusId)
+    {
+        dramGBs = 2.0 * memoryClockKHz * 1e3 * (busWidthBits / 8) / 1e9;
+        linkGBs = 0;
+        if (pciBusId && readLink(pciBusId, &linkGTs, &linkWidth))
+            linkGBs = linkGTs * linkWidth * encoding(linkGTs) / 8;
+    }
+
+    // Threads the pooled host peak is measured with.
+    void setHostThreads(int threads)
+    {
+        hostThreads = threads > 1 ? threads : 1;
+        hostPoolGBs = 0;
+    }
+
+    void printPeaks()
+    {
+        if (dramGBs > 0)
+            printf("  Peak DRAM bandwidth:             %.1f GB/s\n", dramGBs);
+        else
+            printf("  Peak DRAM bandwidth:             unknown\n");
+        if (linkGBs > 0)
+            printf("  Peak link bandwidth:             %.1f GB/s (PCIe gen %d x%d)\n",
+                   linkGBs, generation(linkGTs), linkWidth);
+        else
+            printf("  Peak link bandwidth:             unknown\n");
+    }
+
+    // Bandwidth of the given kind this machine can reach, GB/s.
+    double peak(RooflinePeak kind)
+    {
+        if (kind == PEAK_DRAM && dramGBs > 0)
+            return dramGBs;
+        if (kind == PEAK_LINK && linkGBs > 0)
+            return linkGBs;
+        if (kind == PEAK_HOST_POOL)
+            return hostPoolPeak();
+        return hostPeak();
+    }
+
+    // One line per phase: bytes moved in ms, against the peak of its kind.
+    void report(const char *phase, RooflinePeak kind, double bytes, double ms)
+    {
+        static const char *kinds[] = { "DRAM", "link", "host", "host pool" };
+        // without a DRAM or link figure the phase ran through host memory
+        // and is labelled as such
+        bool measured = (kind == PEAK_HOST || kind == PEAK_HOST_POOL) ||
+                        (kind == PEAK_DRAM ? dramGBs : linkGBs) <= 0;
+        if (measured && kind != PEAK_HOST_POOL)
+            kind = PEAK_HOST;
+        double limit = peak(kind);
+        double achieved = (ms > 0) ? bytes / (ms * 1e6) : 0;
+        char source[48] = "";
+        if (kind == PEAK_HOST_POOL)
+            snprintf(source, sizeof(source), ", host STREAM x%d threads", hostThreads);
+        else if (measured)
+            snprintf(source, sizeof(source), ", host STREAM");
+        printf("  %-8s %10.3f ms %8.2f GB/s %6.1f%% of %s peak (%.1f GB/s%s)\n",
+               phase, ms, achieved, limit > 0 ? 100 * achieved / limit : 0,
+               kinds[kind], limit, source);
+    }
+
+    // STREAM add on one host thread; measured once.
+    double hostPeak()
+    {
+        if (hostGBs <= 0)
+            hostGBs = stream(1);
+        return hostGBs;
+    }
+
+    // STREAM add split over hostThreads threads; measured once per count.
+    double hostPoolPeak()
+    {
+        if (hostThreads == 1)
+            return hostPeak();
+        if (hostPoolGBs <= 0)
+            hostPoolGBs = stream(hostThreads);
+        return hostPoolGBs;
+    }
+
+private:
+    // Best of STREAM_REPEATS, the arrays cut into one contiguous slice per
+    // thread; the caller adds the last slice itself.
+    static double stream(int threads)
+    {
+        std::vector<int> a(STREAM_ELEMENTS, 1), b(STREAM_ELEMENTS, 2), c(STREAM_ELEMENTS);
+        size_t slice = (c.size() + threads - 1) / threads;
+        double best = 0;
+        for (int r = 0; r < STREAM_REPEATS; ++r) {
+            std::vector<std::thread> workers;
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            for (int t = 0; t < threads; ++t) {
+                size_t begin = t * slice;
+                size_t end = std::min(begin + slice, c.size());
+                if (t == threads - 1) {
+                    addSlice(a.data(), b.data(), c.data(), begin, end);
+                    break;
+                }
+                workers.push_back(std::thread(addSlice, a.data(), b.data(), c.data(), begin, end));
+            }
+            for (size_t t = 0; t < workers.size(); ++t)
+                workers[t].join();
+            double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            double gbs = 3.0 * sizeof(int) * c.size() / (s * 1e9);
+            if (gbs > best && c[c.size() / 2] == 3)
+                best = gbs;
+        }
+        return best;
+    }
+
+    static void addSlice(const int *a, const int *b, int *c, size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            c[i] = a[i] + b[i];
+    }
+
+    // PCIe 1.x/2.x use 8b/10b, 3.x to 5.x 128b/130b, 6.x FLIT mode 242/256.
+    static double encoding(double gts)
+    {
+        if (gts <= 5.0)
+            return 8.0 / 10.0;
+        if (gts <= 32.0)
+            return 128.0 / 130.0;
+        return 242.0 / 256.0;
+    }
+
+    static int generation(double gts)
+    {
+        static const double rates[] = { 2.5, 5, 8, 16, 32, 64 };
+        for (int g = 0; g < 6; ++g)
+            if (gts <= rates[g] + 0.1)
+                return g + 1;
+        return 0;
+    }
+
+    // sysfs names devices in lower case.
+    static bool readLink(const char *busId, double *gts, int *width)
+    {
+        char id[32], path[128];
+        size_t i = 0;
+        for (; busId[i] && i < sizeof(id) - 1; ++i)
+            id[i] = (char)tolower((unsigned char)busId[i]);
+        id[i] = '\0';
+
+        snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/max_link_speed", id);
+        FILE *f = fopen(path, "r");
+        if (!f)
+            return false;
+        int ok = fscanf(f, "%lf", gts);
+        fclose(f);
+
+        snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/current_link_width", id);
+        if (ok != 1 || !(f = fopen(path, "r")))
+            return false;
+        ok = fscanf(f, "%d", width);
+        fclose(f);
+        return ok == 1 && *gts > 0 && *width > 0;
+    }
+
+    double dramGBs;
+    double linkGBs;
+    double linkGTs;
+    int    linkWidth;
+    double hostGBs;
+    int    hostThreads;
+    double hostPoolGBs;
+};
+
+#endif // CUDA_ROOFLINE_H
@@ -0,0 +1,135 @@
+/*
+ * Typed, non-owning views of device and host memory.
+ *
+ * device_span<T> and host_span<T> carry a pointer, an element count and the
+ * memory space, so a kernel or a copy can check that its operands agree
+ * instead of trusting a separate n. subspan() and first() cut a view into
+ * sub-ranges in O(1) without touching the memory, which lets a chunked
+ * pipeline reuse one pooled allocation for every chunk:
+ *
+ *     DeviceBuffer<int> d_a;                  // sized for one chunk
+ *     checkCudaErrors( d_a.allocate(chunk, "input") );
+ *     for (offset = 0; offset < n; offset += chunk)
+ *         copyToDevice(d_a.span().first(m), a.subspan(offset, m));
+ *
+ * A span of T converts to a span of const T. Views do not keep the memory
+ * alive; the owner (cuda_handles.h, or plain host memory) must outlive them.
+ */
+
+#ifndef CUDA_SPAN_H
+#define CUDA_SPAN_H
+
+#include <stddef.h>
+#include <cuda.h>
+#include <type_traits>
+
+#include "cuda_accounting.h"
+#include "cuda_driver.h"
+
+// --- device span ---------------------------------------------------------
+template <typename T>
+class device_span {
+public:
+    device_span() : ptr(0), count(0) {}
+    device_span(CUdeviceptr ptr, size_t count) : ptr(ptr), count(count) {}
+
+    // device_span<T> -> device_span<const T>
+    template <typename U, typename = typename std::enable_if<std::is_same<const U, T>::value &&
+                                                             !std::is_same<U, T>::value>::type>
+    device_span(const device_span<U> &other) : ptr(other.data()), count(other.size()) {}
+
+    CUdeviceptr data() const  { return ptr; }
+    size_t      size() const  { return count; }
+    size_t      bytes() const { return sizeof(T) * count; }
+    bool        empty() const { return count == 0; }
+    MemorySpace space() const { return MEM_DEVICE; }
+
+    // count elements from offset, clipped to the span.
+    device_span subspan(size_t offset, size_t n) const
+    {
+        if (offset > count)
+            offset = count;
+        if (n > count - offset)
+            n = count - offset;
+        return device_span(ptr + sizeof(T) * offset, n);
+    }
+
+    device_span first(size_t n) const { return subspan(0, n); }
+
+private:
+    CUdeviceptr ptr;
+    size_t      count;
+};
+
+// --- host span -----------------------------------------------------------
+// Pageable by default; pinned memory is marked so that copies from it can
+// run asynchronously.
+template <typename T>
+class host_span {
+public:
+    host_span() : ptr(NULL), count(0), where(MEM_PAGEABLE) {}
+    host_span(T *ptr, size_t count, MemorySpace where = MEM_PAGEABLE)
+        : ptr(ptr), count(count), where(where) {}
+
+    // host_span<T> -> host_span<const T>
+    template <typename U, typename = typename std::enable_if<std::is_same<const U, T>::value &&
+                                                             !std::is_same<U, T>::value>::type>
+    host_span(const host_span<U> &other)
+        : ptr(other.data()), count(other.size()), where(other.space()) {}
+
+    T          *data() const  { return ptr; }
+    size_t      size() const  { return count; }
+    size_t      bytes() const { return sizeof(T) * count; }
+    bool        empty() const { return count == 0; }
+    MemorySpace space() const { return where; }
+
+    T &operator[](size_t i) const { return ptr[i]; }
+    T *begin() const { return ptr; }
+    T *end() const   { return ptr + count; }
+
+    // count elements from offset, clipped to the span.
+    host_span subspan(size_t offset, size_t n) const
+    {
+        if (offset > count)
+            offset = count;
+        if (n > count - offset)
+            n = count - offset;
+        return host_span(ptr + offset, n, where);
+    }
+
+    host_span first(size_t n) const { return subspan(0, n); }
+
+private:
+    T          *ptr;
+    size_t      count;
+    MemorySpace where;
+};
+
+// --- copies --------------------------------------------------------------
+// Both views must hold the same number of elements of the same type. With a
+// stream the copy is queued on it, otherwise it completes before returning.
+template <typename T, typename U>
+inline CUresult copyToDevice(device_span<T> dst, host_span<U> src, CUstream stream = 0)
+{
+    static_assert(std::is_same<typename std::remove_const<U>::type, T>::value,
+                  "copyToDevice: element types differ");
+    if (dst.size() != src.size())
+        return CUDA_ERROR_INVALID_VALUE;
+    if (stream)
+        return drv.cuMemcpyHtoDAsync(dst.data(), src.data(), src.bytes(), stream);
+    return drv.cuMemcpyHtoD(dst.data(), src.data(), src.bytes());
+}
+
+template <typename T, typename U>
+inline CUresult copyToHost(host_span<T> dst, device_span<U> src, CUstream stream = 0)
+{
+    static_assert(std::is_same<typename std::remove_const<U>::type, T>::value,
+                  "copyToHost: element types differ");
+    if (dst.size() != src.size())
+        return CUDA_ERROR_INVALID_VALUE;
+    if (stream)
+        return drv.cuMemcpyDtoHAsync(dst.data(), src.data(), src.bytes(), stream);
+    return drv.cuMemcpyDtoH(dst.data(), src.data(), src.bytes());
+}
+
+#endif // CUDA_SPAN_H
@@ -0,0 +1,556 @@
+/*
+ * Recording of driver calls into a compact binary log.
+ *
+ * startTrace() swaps the memory, stream, launch and synchronisation
+ * entries of the driver table for wrappers that forward to the backend and
+ * append one TraceRecord per call: which buffer (by allocation id and
+ * offset), how many bytes, which stream, the launch configuration and
+ * decoded kernel arguments, the result and the time spent in the call.
+ * Device pointers are logged relative to the allocation they fall in, so
+ * replay.cpp can re-create the same sequence against any backend.
+ *
+ * initCUDA() starts a trace when VADD_TRACE=<file> is set. Timings of
+ * asynchronous calls are submission times; synchronous calls and
+ * cuStreamSynchronize carry the time the work actually took.
+ */
+
+#ifndef CUDA_TRACE_H
+#define CUDA_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cuda.h>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cuda_driver.h"
+#include "kernel_host.h"
+
+// --- log format ----------------------------------------------------------
+#define TRACE_MAGIC   0x31525456u       // "VTR1"
+#define TRACE_VERSION 1
+#define TRACE_MAX_PARAMS 16
+
+enum TraceOp {
+    TRACE_ALLOC,            // id = new buffer, bytes
+    TRACE_FREE,             // id
+    TRACE_ALLOC_HOST,       // id = new pinned buffer, bytes
+    TRACE_FREE_HOST,        // id
+    TRACE_HTOD,             // id/offset = device side, bytes, flags
+    TRACE_DTOH,
+    TRACE_HTOD_ASYNC,
+    TRACE_DTOH_ASYNC,
+    TRACE_DTOD,             // id/offset = destination, srcId/srcOffset = source
+    TRACE_LAUNCH,           // id = function, grid, block, shared; params follow
+    TRACE_STREAM_CREATE,    // stream = new stream id, flags, priority in offset
+    TRACE_STREAM_DESTROY,
+    TRACE_STREAM_SYNC,
+    TRACE_HOST_FUNC,
+    TRACE_FUNCTION,         // id = function; a name of `params` bytes follows
+    TRACE_OPS
+};
+
+// Host side of a copy came from cuMemAllocHost.
+#define TRACE_PINNED 1u
+
+struct TraceHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t paramSize;
+};
+
+struct TraceRecord {
+    uint16_t op;
+    uint16_t result;
+    uint16_t stream;
+    uint16_t params;        // TRACE_LAUNCH: TraceParams that follow
+    uint32_t id;
+    uint32_t flags;
+    uint64_t bytes;
+    uint64_t offset;
+    uint32_t srcId;
+    uint32_t grid;
+    uint64_t srcOffset;
+    uint32_t block;
+    uint32_t shared;
+    uint64_t startNs;       // since the start of the trace
+    uint64_t durationNs;
+};
+
+enum TraceParamKind {
+    TRACE_PARAM_VALUE,      // value holds the integer argument
+    TRACE_PARAM_BUFFER,     // id/value = device allocation id and offset
+    TRACE_PARAM_PINNED      // id/value = pinned host allocation (UVA)
+};
+
+struct TraceParam {
+    uint32_t kind;
+    uint32_t id;
+    uint64_t value;
+};
+
+inline const char *traceOpName(int op)
+{
+    static const char *names[TRACE_OPS] = {
+        "alloc", "free", "alloc_host", "free_host", "htod", "dtoh",
+        "htod_async", "dtoh_async", "dtod", "launch", "stream_create",
+        "stream_destroy", "stream_sync", "host_func", "function"
+    };
+    return (op >= 0 && op < TRACE_OPS) ? names[op] : "?";
+}
+
+// --- recorder ------------------------------------------------------------
+class DriverTrace {
+public:
+    DriverTrace() : file(NULL), nextId(1), nextStream(1) {}
+
+    bool open(const char *path)
+    {
+        file = fopen(path, "wb");
+        if (!file)
+            return false;
+        TraceHeader header = { TRACE_MAGIC, TRACE_VERSION,
+                               sizeof(TraceRecord), sizeof(TraceParam) };
+        fwrite(&header, sizeof(header), 1, file);
+        start = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (file)
+            fclose(file);
+        file = NULL;
+    }
+
+    bool active() const { return file != NULL; }
+
+    uint64_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Fill in the common fields and append the record.
+    void write(TraceRecord &rec, uint64_t t0, CUresult result,
+               const TraceParam *params = NULL, const char *name = NULL)
+    {
+        rec.startNs = t0;
+        rec.durationNs = now() - t0;
+        rec.result = (uint16_t)result;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!file)
+            return;
+        fwrite(&rec, sizeof(rec), 1, file);
+        if (params)
+            fwrite(params, sizeof(TraceParam), rec.params, file);
+        if (name)
+            fwrite(name, 1, rec.params, file);
+    }
+
+    // --- id bookkeeping --------------------------------------------------
+    uint32_t addBuffer(uint64_t base, uint64_t bytes, bool host)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Range r = { nextId++, bytes };
+        (host ? hostRanges : deviceRanges)[base] = r;
+        return r.id;
+    }
+
+    uint32_t removeBuffer(uint64_t base, bool host)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<uint64_t, Range> &ranges = host ? hostRanges : deviceRanges;
+        std::map<uint64_t, Range>::iterator it = ranges.find(base);
+        if (it == ranges.end())
+            return 0;
+        uint32_t id = it->second.id;
+        ranges.erase(it);
+        return id;
+    }
+
+    // Allocation containing addr: its id and the offset into it, or id 0.
+    uint32_t lookup(uint64_t addr, bool host, uint64_t *offset)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<uint64_t, Range> &ranges = host ? hostRanges : deviceRanges;
+        std::map<uint64_t, Range>::iterator it = ranges.upper_bound(addr);
+        *offset = 0;
+        if (it == ranges.begin())
+            return 0;
+        --it;
+        if (addr >= it->first + it->second.bytes)
+            return 0;
+        *offset = addr - it->first;
+        return it->second.id;
+    }
+
+    uint16_t streamId(CUstream stream)
+    {
+        if (!stream)
+            return 0;
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<CUstream, uint16_t>::iterator it = streams.find(stream);
+        if (it != streams.end())
+            return it->second;
+        uint16_t id = nextStream++;
+        streams[stream] = id;
+        return id;
+    }
+
+    // A destroyed stream's handle may be reused; it then gets a new id.
+    void removeStream(CUstream stream)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        streams.erase(stream);
+    }
+
+    // Remember a function's name and parameter layout; false if known.
+    bool addFunction(CUfunction f, const char *name, uint32_t *id)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<CUfunction, Function>::iterator it = functions.find(f);
+        if (it != functions.end()) {
+            *id = it->second.id;
+            return false;
+        }
+        const HostKernel *kernel = findHostKernel(name);
+        Function fn = { (uint32_t)functions.size() + 1, kernel ? kernel->params : "" };
+        functions[f] = fn;
+        *id = fn.id;
+        return true;
+    }
+
+    bool function(CUfunction f, uint32_t *id, std::string *params)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<CUfunction, Function>::iterator it = functions.find(f);
+        if (it == functions.end())
+            return false;
+        *id = it->second.id;
+        *params = it->second.params;
+        return true;
+    }
+
+private:
+    struct Range    { uint32_t id; uint64_t bytes; };
+    struct Function { uint32_t id; std::string params; };
+
+    std::mutex                            mutex;
+    FILE                                 *file;
+    std::chrono::steady_clock::time_point start;
+    uint32_t                              nextId;
+    uint16_t                              nextStream;
+    std::map<uint64_t, Range>             deviceRanges;
+    std::map<uint64_t, Range>             hostRanges;
+    std::map<CUstream, uint16_t>          streams;
+    std::map<CUfunction, Function>        functions;
+};
+
+DriverTrace driverTrace;
+CudaDriver  traceReal;      // the backend behind the wrappers
+
+// --- wrappers ------------------------------------------------------------
+inline TraceRecord traceRecord(TraceOp op)
+{
+    TraceRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.op = op;
+    return rec;
+}
+
+inline CUresult traceMemAlloc(CUdeviceptr *dptr, size_t bytesize)
+{
+    TraceRecord rec = traceRecord(TRACE_ALLOC);
+    uint64_t t0 = driverTrace.now();
+    CUresult err = traceReal.cuMemAlloc(dptr, bytesize);
+    if (err == CUDA_SUCCESS)
+        rec.id = driverTrace.addBuffer(*dptr, bytesize, false);
+    rec.bytes = bytesize;
+    driverTrace.write(rec, t0, err);
+    return err;
+}
+
+inline CUresult traceMemFree(CUdeviceptr dptr)
+{
+    TraceRecord rec = traceRecord(TRACE_FREE);
+    rec.id = driverTrace.removeBuffer(dptr, false);
+    uint64_t t0 = driverTrace.now();
+    CUresult err = traceReal.cuMemFree(dptr);
+    driverTrace.write(rec, t0, err);
+    return err;
+}
+
+inline CUresult traceMemAllocHost(void **pp, size_t bytesize)
+{
+    TraceRecord rec = traceRecord(TRACE_ALLOC_HOST);
+    uint64_t t0 = driverTrace.now();
+    CUresult err = traceReal.cuMemAllocHost(pp, bytesize);
+    if (err == CUDA_SUCCESS)
+        rec.id = driverTrace.addBuffer((uint64_t)*pp, bytesize, true);
+    rec.bytes = bytesize;
+    driverTrace.write(rec, t0, err);
+    return err;
+}
+
+inline CUresult traceMemFreeHost(void *p)
+{
+    TraceRecord rec = traceRecord(TRACE_FREE_HOST);
+    rec.id = driverTrace.removeBuffer((uint64_t)p, true);
+    uint64_t t0 = driverTrace.now();
+    CUresult err = traceReal.cuMemFreeHost(p);
+    driverTrace.write(rec, t0, err);
+    return err;
+}
+
+// Device side of a copy, plus whether the host side is pinned.
+inline TraceRecord traceCopy(TraceOp op, CUdeviceptr device, const void *host,
+                             size_t bytes, CUstream stream)
+{
+    TraceRecord rec = traceRecord(op);
+    uint64_t hostOffset;
+    rec.id = driverTrace.lookup(device, false, &rec.offset);
+    rec.srcId = driverTrace.lookup((uint64_t)host, true, &hostOffset);
+    rec.srcOffset = hostOffset;
+    rec.flags = rec.srcId ? TRACE_PINNED : 0;
+    rec.bytes = bytes;
+    rec.stream = driverTrace.streamId(stream);
+    return rec;
+}
+
+inline CUresult traceMemcpyHtoD(CUdeviceptr dst, const void *src, size_t bytes)
+{
+    TraceRecord rec = traceCopy(TRACE_HTOD, dst, src, bytes, 0);
+    uint64_t t0 = driverTrace.now();
+    CUresult err = traceReal.cuMemcpyHtoD(dst, src, bytes);
+    driverTrace.write(rec, t0, err);
+    return err;
+}
+
+inline CUresult traceMemcpyDtoH(void *dst, CUdeviceptr src, size_t bytes)
+{
+    TraceRecord rec = traceCopy(TRACE_DTOH, src, dst, bytes, 0);
+    uint64_t t0 = driverTrace.now();
+    CUresult err = traceReal.cuMemcpyDtoH(dst, src, bytes);
+    driverTrace.write(rec, t0, err);
+    return err;
+}
+
+inline CUresult traceMemcpyHtoDAsync(CUdeviceptr dst, const void *src, size_t bytes, CUstream stream)
+{
+    TraceRecord rec = traceCopy(TRACE_HTOD_ASYNC, dst, src, bytes, stream);
+    uint64_t t0 = driverTrace.now();
+    CUresult err = traceReal.cuMemcpyHtoDAsync(dst, src, bytes, stream);
+    driverTrace.write(rec, t0, err);
+    return err;
+}
+
+inline CUresult traceMemcpyDtoHAsync(void *dst, CUdeviceptr src, size_t bytes, CUstream stream)
+{
+    TraceRecord rec = traceCopy(TRACE_DTOH_ASYNC, src, dst, bytes, stream);
+    uint64_t t0 = driverTrace.now();
+    CUresult err = traceReal.cuMemcpyDtoHAsync(dst, src, bytes, stream);
+    driverTrace.write(rec, t0, err);
+    return err;
+}
+
+inline CUresult traceMemcpyPeerAsync(CUdeviceptr dst, CUcontext dstCtx, CUdeviceptr src, CUcontext srcCtx,
+                                     size_t bytes, CUstream stream)
+{
+    TraceRecord rec = traceRecord(TRACE_DTOD);
+    uint64_t srcOffset;
+    rec.id = driverTrace.lookup(dst, false, &rec.offset);
+    rec.srcId = driverTrace.lookup(src, false, &srcOffset);
+    rec.srcOffset = srcOffset;
+    rec.bytes = bytes;
+    rec.stream = driverTrace.streamId(stream);
+    uint64_t t0 = driverTrace.now();
+    CUresult err = traceReal.cuMemcpyPeerAsync(dst, dstCtx, src, srcCtx, bytes, stream);
+    driverTrace.write(rec, t0, err);
+    return err;
+}
+
+inline CUresult traceModuleGetFunction(CUfunction *hfunc, CUmodule hmod, const char *name)
+{
+    CUresult err = traceReal.cuModuleGetFunction(hfunc, hmod, name);
+    uint32_t id;
+    if (err == CUDA_SUCCESS && driverTrace.addFunction(*hfunc, name, &id)) {
+        TraceRecord rec = traceRecord(TRACE_FUNCTION);
+        rec.id = id;
+        rec.params = (uint16_t)strlen(name);
+        driverTrace.write(rec, driverTrace.now(), err, NULL, name);
+    }
+    return err;
+}
+
+inline CUresult traceLaunchKernel(CUfunction f,
+                                  unsigned int gridDimX, unsigned int gridDimY, unsigned int gridDimZ,
+                                  unsigned int blockDimX, unsigned int blockDimY, unsigned int blockDimZ,
+                                  unsigned int sharedMemBytes, CUstream hStream,
+                                  void **kernelParams, void **extra)
+{
+    TraceRecord rec = traceRecord(TRACE_LAUNCH);
+    TraceParam params[TRACE_MAX_PARAMS];
+    std::string layout;
+
+    if (driverTrace.function(f, &rec.id, &layout) && kernelParams) {
+        for (size_t i = 0; i < layout.size() && i < TRACE_MAX_PARAMS; ++i) {
+            TraceParam &p = params[rec.params++];
+            p.id = 0;
+            if (layout[i] == 'p') {
+                CUdeviceptr ptr = kernelArg<CUdeviceptr>(kernelParams, i);
+                p.kind = TRACE_PARAM_BUFFER;
+                p.id = driverTrace.lookup(ptr, false, &p.value);
+                if (!p.id) {
+                    p.kind = TRACE_PARAM_PINNED;
+                    p.id = driverTrace.lookup(ptr, true, &p.value);
+                }
+            } else {
+                p.kind = TRACE_PARAM_VALUE;
+                p.value = (uint64_t)(int64_t)kernelArg<int>(kernelParams, i);
+            }
+        }
+    }
+    rec.grid = gridDimX * gridDimY * gridDimZ;
+    rec.block = blockDimX * blockDimY * blockDimZ;
+    rec.shared = sharedMemBytes;
+    rec.stream = driverTrace.streamId(hStream);
+
+    uint64_t t0 = driverTrace.now();
+    CUresult err = traceReal.cuLaunchKernel(f, gridDimX, gridDimY, gridDimZ,
+                                            blockDimX, blockDimY, blockDimZ,
+                                            sharedMemBytes, hStream, kernelParams, extra);
+    driverTrace.write(rec, t0, err, params);
+    return err;
+}
+
+inline CUresult traceStreamCreateWithPriority(CUstream *phStream, unsigned int flags, int priority)
+{
+    TraceRecord rec = traceRecord(TRACE_STREAM_CREATE);
+    uint64_t t0 = driverTrace.now();
+    CUresult err = traceReal.cuStreamCreateWithPriority(phStream, flags, priority);
+    if (err == CUDA_SUCCESS)
+        rec.stream = driverTrace.streamId(*phStream);
+    rec.flags = flags;
+    rec.offset = (uint64_t)(int64_t)priority;
+    driverTrace.write(rec, t0, err);
+    return err;
+}
+
+inline CUresult traceStreamCreate(CUstream *phStream, unsigned int flags)
+{
+    return traceStreamCreateWithPriority(phStream, flags, 0);
+}
+
+inline CUresult traceStreamDestroy(CUstream hStream)
+{
+    TraceRecord rec = traceRecord(TRACE_STREAM_DESTROY);
+    rec.stream = driverTrace.streamId(hStream);
+    uint64_t t0 = driverTrace.now();
+    CUresult err = traceReal.cuStreamDestroy(hStream);
+    driverTrace.removeStream(hStream);
+    driverTrace.write(rec, t0, err);
+    return err;
+}
+
+inline CUresult traceStreamSynchronize(CUstream hStream)
+{
+    TraceRecord rec = traceRecord(TRACE_STREAM_SYNC);
+    rec.stream = driverTrace.streamId(hStream);
+    uint64_t t0 = driverTrace.now();
+    CUresult err = traceReal.cuStreamSynchronize(hStream);
+    driverTrace.write(rec, t0, err);
+    return err;
+}
+
+inline CUresult traceLaunchHostFunc(CUstream hStream, CUhostFn fn, void *userData)
+{
+    TraceRecord rec = traceRecord(TRACE_HOST_FUNC);
+    rec.stream = driverTrace.streamId(hStream);
+    uint64_t t0 = driverTrace.now();
+    CUresult err = traceReal.cuLaunchHostFunc(hStream, fn, userData);
+    driverTrace.write(rec, t0, err);
+    return err;
+}
+
+inline void stopTrace()
+{
+    driverTrace.close();
+}
+
+// Route the recorded entry points of drv through the wrappers. Must run
+// after the backend is loaded and before any buffer is allocated.
+inline bool startTrace(const char *path)
+{
+    if (driverTrace.active() || !driverTrace.open(path))
+        return false;
+
+    traceReal = drv;
+    drv.cuMemAlloc                 = traceMemAlloc;
+    drv.cuMemFree                  = traceMemFree;
+    drv.cuMemAllocHost             = traceMemAllocHost;
+    drv.cuMemFreeHost              = traceMemFreeHost;
+    drv.cuMemcpyHtoD               = traceMemcpyHtoD;
+    drv.cuMemcpyDtoH               = traceMemcpyDtoH;
+    drv.cuMemcpyHtoDAsync          = traceMemcpyHtoDAsync;
+    drv.cuMemcpyDtoHAsync          = traceMemcpyDtoHAsync;
+    drv.cuMemcpyPeerAsync          = traceMemcpyPeerAsync;
+    drv.cuModuleGetFunction        = traceModuleGetFunction;
+    drv.cuLaunchKernel             = traceLaunchKernel;
+    drv.cuStreamCreate             = traceStreamCreate;
+    drv.cuStreamCreateWithPriority = traceStreamCreateWithPriority;
+    drv.cuStreamDestroy            = traceStreamDestroy;
+    drv.cuStreamSynchronize        = traceStreamSynchronize;
+    drv.cuLaunchHostFunc           = traceLaunchHostFunc;
+    atexit(stopTrace);
+    return true;
+}
+
+// --- reader --------------------------------------------------------------
+struct TraceEntry {
+    TraceRecord             rec;
+    std::vector<TraceParam> params;
+    std::string             name;       // TRACE_FUNCTION only
+};
+
+inline bool readTrace(const char *path, std::vector<TraceEntry> *entries)
+{
+    FILE *in = fopen(path, "rb");
+    if (!in)
+        return false;
+
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != TRACE_MAGIC ||
+        header.version != TRACE_VERSION || header.recordSize != sizeof(TraceRecord) ||
+        header.paramSize != sizeof(TraceParam)) {
+        fclose(in);
+        return false;
+    }
+
+    TraceEntry e;
+    while (fread(&e.rec, sizeof(e.rec), 1, in) == 1) {
+        e.params.clear();
+        e.name.clear();
+        if (e.rec.op == TRACE_FUNCTION) {
+            e.name.resize(e.rec.params);
+            if (fread(&e.name[0], 1, e.rec.params, in) != e.rec.params)
+                break;
+        } else if (e.rec.params) {
+            e.params.resize(e.rec.params);
+            if (fread(&e.params[0], sizeof(TraceParam), e.rec.params, in) != e.rec.params)
+                break;
+        }
+        entries->push_back(e);
+    }
+    fclose(in);
+    return true;
+}
+
+#endif // CUDA_TRACE_H
@@ -0,0 +1,107 @@
+/*
+ * Verification on the device.
+ *
+ * Checking a result on the host means copying all of c back (4n bytes)
+ * and a host pass over a, b and c. The Verify and VerifyRef kernels
+ * (kernel.cu) compare c where it already is, against a + b or against a
+ * reference buffer, and only a mismatch count and the first mismatching
+ * index (8 bytes) come back over the link.
+ *
+ * The kernels are looked up in `module` on first use.
+ */
+
+#ifndef CUDA_VERIFY_H
+#define CUDA_VERIFY_H
+
+#include <cuda.h>
+
+#include "cuda_handles.h"
+
+#define VERIFY_NO_MISMATCH 0xffffffffu
+
+struct VerifyResult {
+    unsigned int mismatches;
+    unsigned int firstIndex;    // VERIFY_NO_MISMATCH when there is none
+};
+
+CUfunction verifyFunction = NULL;
+CUfunction verifyRefFunction = NULL;
+
+// Fold the result of a slice that starts at offset into the whole job's.
+inline void mergeVerifyResult(VerifyResult *total, const VerifyResult &slice, size_t offset)
+{
+    if (slice.mismatches && (total->mismatches == 0 || offset + slice.firstIndex < total->firstIndex))
+        total->firstIndex = (unsigned int)(offset + slice.firstIndex);
+    total->mismatches += slice.mismatches;
+}
+
+// Launch fn over n elements with its argc args, the last of which this
+// fills in with the result buffer, and copy the 8-byte result back once
+// the stream reaches it.
+inline CUresult runVerifyKernel(CUfunction fn, void **args, int argc, int n,
+                                VerifyResult *result, CUstream stream)
+{
+    DeviceBuffer<unsigned int> d_result;
+    VerifyResult initial = { 0, VERIFY_NO_MISMATCH };
+    int block_size;
+    CUresult err = drv.cuDeviceGetAttribute(&block_size, CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_X, device);
+    if (err == CUDA_SUCCESS)
+        err = d_result.allocate(2, "verify");
+    if (err != CUDA_SUCCESS)
+        return err;
+    CUdeviceptr d_resultPtr = d_result.get();
+    args[argc - 1] = &d_resultPtr;
+
+    err = drv.cuMemcpyHtoDAsync(d_result.get(), &initial, sizeof(initial), stream);
+    if (err == CUDA_SUCCESS && n > 0)
+        err = drv.cuLaunchKernel(fn, (n + block_size - 1) / block_size, 1, 1, block_size, 1, 1,
+                                 0, stream, args, 0);
+    if (err == CUDA_SUCCESS)
+        err = drv.cuMemcpyDtoHAsync(result, d_result.get(), sizeof(*result), stream);
+    if (err == CUDA_SUCCESS)
+        err = drv.cuStreamSynchronize(stream);
+    return err;
+}
+
+inline CUresult lookupVerifyKernels()
+{
+    CUresult err = CUDA_SUCCESS;
+    if (!verifyFunction)
+        err = drv.cuModuleGetFunction(&verifyFunction, module.get(), "Verify");
+    if (err == CUDA_SUCCESS && !verifyRefFunction)
+        err = drv.cuModuleGetFunction(&verifyRefFunction, module.get(), "VerifyRef");
+    return err;
+}
+
+// c against a + b, after the work already queued on stream.
+inline CUresult verifyOnDevice(device_span<const int> a, device_span<const int> b,
+                               device_span<const int> c, VerifyResult *result,
+                               CUstream stream = 0)
+{
+    if (a.size() != c.size() || b.size() != c.size())
+        return CUDA_ERROR_INVALID_VALUE;
+    CUresult err = lookupVerifyKernels();
+    if (err != CUDA_SUCCESS)
+        return err;
+    CUdeviceptr d_a = a.data(), d_b = b.data(), d_c = c.data();
+    int n = (int)c.size();
+    void *args[] = { &d_a, &d_b, &d_c, &n, NULL };
+    return runVerifyKernel(verifyFunction, args, 5, n, result, stream);
+}
+
+// c against a reference computed some other way.
+inline CUresult verifyAgainst(device_span<const int> ref, device_span<const int> c,
+                              VerifyResult *result, CUstream stream = 0)
+{
+    if (ref.size() != c.size())
+        return CUDA_ERROR_INVALID_VALUE;
+    CUresult err = lookupVerifyKernels();
+    if (err != CUDA_SUCCESS)
+        return err;
+    CUdeviceptr d_ref = ref.data(), d_c = c.data();
+    int n = (int)c.size();
+    void *args[] = { &d_ref, &d_c, &n, NULL };
+    return runVerifyKernel(verifyRefFunction, args, 4, n, result, stream);
+}
+
+#endif // CUDA_VERIFY_H
@@ -6,163 +6,543 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <cuda.h>
+#include <thread>
+
+#include "cuda_handles.h"
+#include "cuda_verify.h"
+#include "pack_codec.h"
+#include "sample_verify.h"
+#include "sparse_vector.h"
 
 #define N 10
+#define VERIFY_SAMPLES 100000    // default for VADD_VERIFY=sample
 
-// This will output the proper CUDA error strings
-// in the event that a CUDA host call returns an error
-#define checkCudaErrors(err)  __checkCudaErrors (err, __FILE__, __LINE__)
+// --- functions -----------------------------------------------------------
+// Device memory a job of n elements holds once admitted.
+size_t jobDeviceBytes(int n)
+{
+    return 3 * DeviceMemoryPool::blockSize(sizeof(int) * n);
+}
 
-inline void __checkCudaErrors( CUresult err, const char *file, const int line )
+// c = a + b over three device views of the same length.
+void runKernel(device_span<const int> a, device_span<const int> b, device_span<int> c)
 {
-    if( CUDA_SUCCESS != err) {
-        fprintf(stderr,
-                "CUDA Driver API error = %04d from file <%s>, line %i.\n",
-                err, file, line );
-        exit(-1);
-    }
+    if (a.size() != c.size() || b.size() != c.size())
+        checkCudaErrors( CUDA_ERROR_INVALID_VALUE );
+    CUdeviceptr d_a = a.data(), d_b = b.data(), d_c = c.data();
+    int n = (int)c.size();
+    void *args[] = { &d_a, &d_b, &d_c ,&n};
+    int block_size;
+    checkCudaErrors(drv.cuDeviceGetAttribute(&block_size, CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_X, device));
+
+    checkCudaErrors( drv.cuLaunchKernel(function, 
+                                    (n+block_size-1)/block_size, 1, 1,  // Grid dim
+                                    block_size, 1, 1,                   // Threads dim
+                                    0, 0, args, 0) );
 }
 
-// --- global variables ----------------------------------------------------
-CUdevice   device;
-CUcontext  context;
-CUmodule   module;
-CUfunction function;
-size_t     totalGlobalMem;
+// Launch fn with one thread per unit of work, if there is any.
+void launchOver(CUfunction fn, int threads, void **args)
+{
+    if (threads <= 0)
+        return;
+    int block_size;
+    checkCudaErrors(drv.cuDeviceGetAttribute(&block_size, CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_X, device));
+    checkCudaErrors( drv.cuLaunchKernel(fn, (threads+block_size-1)/block_size, 1, 1,
+                                        block_size, 1, 1, 0, 0, args, 0) );
+}
 
-char       *module_file = (char*) "kernel.ptx";
-char       *kernel_name = (char*) "Sum";
+// Time spent in each device phase, summed over the chunks, the bytes each
+// moved and the chunk size used. encodeMs is the host time spent packing
+// or gathering inputs and expanding sparse results; hostMs is the add of
+// the elements left on the host, by the host route or the split.
+struct PhaseTimes {
+    double htodMs, kernelMs, dtohMs, verifyMs, encodeMs, hostMs;
+    double htodBytes, kernelBytes, dtohBytes;
+    int    chunk;
+};
 
+bool       packInputs = false;          // VADD_COMPRESS: send a and b packed
+CUfunction sumPacked = NULL;            // looked up on first use
+double     sparseDensityA = 0;          // VADD_SPARSE_A: share of a that is non-zero
+double     sparseDensityB = 0;          // VADD_SPARSE: share of b that is non-zero
+CUfunction sumSparseDense = NULL;
+CUfunction sumSparseSparse = NULL;
 
-// --- functions -----------------------------------------------------------
-void initCUDA()
+// A job that cannot fit the device memory budget runs in chunks, all
+// through one set of chunk-sized buffers; returns how many chunks. With
+// verify set, each chunk is checked on the device instead of being copied
+// back, and c is left untouched.
+int runOnDevice(host_span<const int> a, host_span<const int> b, host_span<int> c,
+                PhaseTimes *times, VerifyResult *verify)
 {
-    int deviceCount = 0;
-    CUresult err = cuInit(0);
-    int major = 0, minor = 0;
+    int n = (int)c.size();
+    int chunk = (int)admission.chunkElements(n, 3 * sizeof(int));
+    times->chunk = chunk;
+    if (chunk < n)
+        printf("# Splitting %d elements into chunks of %d\n", n, chunk);
 
-    if (err == CUDA_SUCCESS)
-        checkCudaErrors(cuDeviceGetCount(&deviceCount));
+    // wait until the device has room for one chunk, then allocate it
+    checkCudaErrors( admission.admit(jobDeviceBytes(chunk)) );
+    DeviceBuffer<int> d_a, d_b, d_c;
+    checkCudaErrors( d_a.allocate(chunk, "input") );
+    checkCudaErrors( d_b.allocate(chunk, "input") );
+    checkCudaErrors( d_c.allocate(chunk, "output") );
 
-    if (deviceCount == 0) {
-        fprintf(stderr, "Error: no devices supporting CUDA\n");
-        exit(-1);
+    for (int offset = 0; offset < n; offset += chunk) {
+        int m = (n - offset < chunk) ? n - offset : chunk;
+        device_span<int> da = d_a.span().first(m), db = d_b.span().first(m),
+                         dc = d_c.span().first(m);
+
+        // copy arrays to device
+        startup_clock::time_point t0 = startup_clock::now();
+        checkCudaErrors( copyToDevice(da, a.subspan(offset, m)) );
+        checkCudaErrors( copyToDevice(db, b.subspan(offset, m)) );
+        times->htodMs += elapsedMs(t0);
+        times->htodBytes += (double)(da.bytes() + db.bytes());
+        times->kernelBytes += (double)(da.bytes() + db.bytes() + dc.bytes());
+
+        // run
+        t0 = startup_clock::now();
+        runKernel(da, db, dc);
+        checkCudaErrors( drv.cuStreamSynchronize(0) );
+        times->kernelMs += elapsedMs(t0);
+
+        // check on the device, or copy results to host
+        t0 = startup_clock::now();
+        if (verify) {
+            VerifyResult chunkResult;
+            checkCudaErrors( verifyOnDevice(da, db, dc, &chunkResult) );
+            mergeVerifyResult(verify, chunkResult, offset);
+            times->verifyMs += elapsedMs(t0);
+        } else {
+            checkCudaErrors( copyToHost(c.subspan(offset, m), dc) );
+            times->dtohMs += elapsedMs(t0);
+            times->dtohBytes += (double)dc.bytes();
+        }
     }
 
-    // get first CUDA device
-    checkCudaErrors(cuDeviceGet(&device, 0));
+    d_a.reset();
+    d_b.reset();
+    d_c.reset();
+    admission.release(jobDeviceBytes(chunk));
+    return (n + chunk - 1) / chunk;
+}
+
+// Device memory a packed chunk of n elements holds: both inputs at worst
+// one word per element (rounded up to whole blocks) plus their headers, and
+// the output.
+size_t packedJobBytes(int n)
+{
+    size_t words = DeviceMemoryPool::blockSize(sizeof(unsigned int) * packBlocks(n) * PACK_BLOCK);
+    size_t headers = DeviceMemoryPool::blockSize(sizeof(PackHeader) * packBlocks(n));
+    return 2 * (words + headers) + DeviceMemoryPool::blockSize(sizeof(int) * n);
+}
 
-    char name[100]; cuDeviceGetName(name, 100, device);
-    printf("> Using device 0: %s\n", name);
+inline CUresult copyPacked(const PackedVector &v, DeviceBuffer<PackHeader> &headers,
+                           DeviceBuffer<unsigned int> &words)
+{
+    CUresult err = copyToDevice(headers.span().first(v.headers.size()),
+                                host_span<const PackHeader>(v.headers.data(), v.headers.size()));
+    if (err == CUDA_SUCCESS && !v.words.empty())
+        err = copyToDevice(words.span().first(v.words.size()),
+                           host_span<const unsigned int>(v.words.data(), v.words.size()));
+    return err;
+}
 
-    // get compute capabilities and the devicename
-    checkCudaErrors(cuDeviceGetAttribute(&major, CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MAJOR, device));
-    checkCudaErrors(cuDeviceGetAttribute(&minor, CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MINOR, device));
-    printf("> GPU Device has SM %d.%d compute capability\n", major, minor);
+// runOnDevice() with a and b packed on the host (pack_codec.h) chunk by
+// chunk and decoded by the SumPacked kernel as it adds; returns how many
+// chunks.
+int runPackedOnDevice(host_span<const int> a, host_span<const int> b, host_span<int> c,
+                      PhaseTimes *times)
+{
+    int n = (int)c.size();
+    int chunk = (int)admission.chunkElements(n, 4 * sizeof(int));   // room for the headers
+    times->chunk = chunk;
+    if (chunk < n)
+        printf("# Splitting %d elements into chunks of %d\n", n, chunk);
+    if (!sumPacked)
+        checkCudaErrors( drv.cuModuleGetFunction(&sumPacked, module.get(), "SumPacked") );
 
-    checkCudaErrors( cuDeviceTotalMem(&totalGlobalMem, device) );
-    printf("  Total amount of global memory:   %llu bytes\n",
-           (unsigned long long)totalGlobalMem);
-    printf("  64-bit Memory Address:           %s\n",
-           (totalGlobalMem > (unsigned long long)4*1024*1024*1024L)?
-           "YES" : "NO");
+    checkCudaErrors( admission.admit(packedJobBytes(chunk)) );
+    DeviceBuffer<PackHeader>   d_ha, d_hb;
+    DeviceBuffer<unsigned int> d_wa, d_wb;
+    DeviceBuffer<int>          d_c;
+    checkCudaErrors( d_ha.allocate(packBlocks(chunk), "input") );
+    checkCudaErrors( d_hb.allocate(packBlocks(chunk), "input") );
+    checkCudaErrors( d_wa.allocate((size_t)packBlocks(chunk) * PACK_BLOCK, "input") );
+    checkCudaErrors( d_wb.allocate((size_t)packBlocks(chunk) * PACK_BLOCK, "input") );
+    checkCudaErrors( d_c.allocate(chunk, "output") );
 
-    err = cuCtxCreate(&context, 0, device);
-    if (err != CUDA_SUCCESS) {
-        fprintf(stderr, "* Error initializing the CUDA context.\n");
-        goto exit;
-    }
+    PackedVector pa, pb;
+    for (int offset = 0; offset < n; offset += chunk) {
+        int m = (n - offset < chunk) ? n - offset : chunk;
+        device_span<int> dc = d_c.span().first(m);
 
-    err = cuModuleLoad(&module, module_file);
-    if (err != CUDA_SUCCESS) {
-        fprintf(stderr, "* Error loading the module %s\n", module_file);
-        goto exit;
-    }
+        // pack and copy the inputs
+        startup_clock::time_point t0 = startup_clock::now();
+        packVector(a.data() + offset, m, &pa);
+        packVector(b.data() + offset, m, &pb);
+        times->encodeMs += elapsedMs(t0);
+        t0 = startup_clock::now();
+        checkCudaErrors( copyPacked(pa, d_ha, d_wa) );
+        checkCudaErrors( copyPacked(pb, d_hb, d_wb) );
+        times->htodMs += elapsedMs(t0);
+        times->htodBytes += (double)(pa.bytes() + pb.bytes());
+        times->kernelBytes += (double)(pa.bytes() + pb.bytes() + dc.bytes());
 
-    err = cuModuleGetFunction(&function, module, kernel_name);
+        // decode and add
+        t0 = startup_clock::now();
+        CUdeviceptr ha = d_ha.get(), wa = d_wa.get(), hb = d_hb.get(), wb = d_wb.get();
+        CUdeviceptr pc = dc.data();
+        void *args[] = { &ha, &wa, &hb, &wb, &pc, &m };
+        checkCudaErrors( drv.cuLaunchKernel(sumPacked, packBlocks(m), 1, 1, PACK_BLOCK, 1, 1,
+                                            0, 0, args, 0) );
+        checkCudaErrors( drv.cuStreamSynchronize(0) );
+        times->kernelMs += elapsedMs(t0);
 
-    if (err != CUDA_SUCCESS) {
-        fprintf(stderr, "* Error getting kernel function %s\n", kernel_name);
-        goto exit;
+        // copy results to host
+        t0 = startup_clock::now();
+        checkCudaErrors( copyToHost(c.subspan(offset, m), dc) );
+        times->dtohMs += elapsedMs(t0);
+        times->dtohBytes += (double)dc.bytes();
     }
-    return;
-exit:
-    cuCtxDestroy(context);
-    exit(-1);
+
+    d_ha.reset();
+    d_hb.reset();
+    d_wa.reset();
+    d_wb.reset();
+    d_c.reset();
+    admission.release(packedJobBytes(chunk));
+    return (n + chunk - 1) / chunk;
 }
 
-void finalizeCUDA()
+// Device memory a sparse chunk of n elements holds, with every element
+// non-zero at worst: the index and value arrays of b, and either a dense c
+// (sparse + dense) or those of a and two of merge slots (sparse + sparse).
+size_t sparseJobBytes(int n, bool both)
 {
-    cuCtxDestroy(context);
+    size_t ints = DeviceMemoryPool::blockSize(sizeof(int) * n);
+    if (both)
+        return 4 * ints + 2 * DeviceMemoryPool::blockSize(sizeof(int) * 2 * (size_t)n);
+    return 3 * ints;
 }
 
-void setupDeviceMemory(CUdeviceptr *d_a, CUdeviceptr *d_b, CUdeviceptr *d_c, int n)
+inline CUresult copySparse(const SparseVector &v, DeviceBuffer<int> &index, DeviceBuffer<int> &value)
 {
-    checkCudaErrors( cuMemAlloc(d_a, sizeof(int) * n) );
-    checkCudaErrors( cuMemAlloc(d_b, sizeof(int) * n) );
-    checkCudaErrors( cuMemAlloc(d_c, sizeof(int) * n) );
+    CUresult err = CUDA_SUCCESS;
+    if (v.nnz() > 0)
+        err = copyToDevice(index.span().first(v.nnz()),
+                           host_span<const int>(v.index.data(), v.nnz()));
+    if (err == CUDA_SUCCESS && v.nnz() > 0)
+        err = copyToDevice(value.span().first(v.nnz()),
+                           host_span<const int>(v.value.data(), v.nnz()));
+    return err;
 }
 
-void releaseDeviceMemory(CUdeviceptr d_a, CUdeviceptr d_b, CUdeviceptr d_c)
+// runOnDevice() with b, and with VADD_SPARSE_A a as well, gathered into
+// index and value arrays (sparse_vector.h) chunk by chunk, so that only
+// the non-zero elements cross the link. Sparse + dense copies a straight
+// into c and scatters b onto it with SumSparseDense; sparse + sparse
+// merges both with SumSparseSparse and the slots are compacted and
+// expanded into c on the host. Returns how many chunks.
+int runSparseOnDevice(host_span<const int> a, host_span<const int> b, host_span<int> c,
+                      PhaseTimes *times)
 {
-    checkCudaErrors( cuMemFree(d_a) );
-    checkCudaErrors( cuMemFree(d_b) );
-    checkCudaErrors( cuMemFree(d_c) );
+    int n = (int)c.size();
+    bool both = sparseDensityA > 0;
+    int chunk = (int)admission.chunkElements(n, (both ? 8 : 3) * sizeof(int));
+    times->chunk = chunk;
+    if (chunk < n)
+        printf("# Splitting %d elements into chunks of %d\n", n, chunk);
+    if (!sumSparseDense)
+        checkCudaErrors( drv.cuModuleGetFunction(&sumSparseDense, module.get(), "SumSparseDense") );
+    if (!sumSparseSparse)
+        checkCudaErrors( drv.cuModuleGetFunction(&sumSparseSparse, module.get(), "SumSparseSparse") );
+
+    // sparse + dense keeps a, then c, in d_ci
+    checkCudaErrors( admission.admit(sparseJobBytes(chunk, both)) );
+    DeviceBuffer<int> d_ai, d_av, d_bi, d_bv, d_ci, d_cv;
+    checkCudaErrors( d_bi.allocate(chunk, "input") );
+    checkCudaErrors( d_bv.allocate(chunk, "input") );
+    checkCudaErrors( d_ci.allocate(both ? 2 * (size_t)chunk : chunk, "output") );
+    if (both) {
+        checkCudaErrors( d_ai.allocate(chunk, "input") );
+        checkCudaErrors( d_av.allocate(chunk, "input") );
+        checkCudaErrors( d_cv.allocate(2 * (size_t)chunk, "output") );
+    }
+
+    SparseVector sa, sb, sc;
+    std::vector<int> slotIndex, slotValue;
+    for (int offset = 0; offset < n; offset += chunk) {
+        int m = (n - offset < chunk) ? n - offset : chunk;
+
+        // gather and copy the inputs
+        startup_clock::time_point t0 = startup_clock::now();
+        toSparse(b.data() + offset, m, &sb);
+        if (both)
+            toSparse(a.data() + offset, m, &sa);
+        times->encodeMs += elapsedMs(t0);
+        t0 = startup_clock::now();
+        checkCudaErrors( copySparse(sb, d_bi, d_bv) );
+        if (both)
+            checkCudaErrors( copySparse(sa, d_ai, d_av) );
+        else
+            checkCudaErrors( copyToDevice(d_ci.span().first(m), a.subspan(offset, m)) );
+        times->htodMs += elapsedMs(t0);
+        times->htodBytes += (double)(sb.bytes() + (both ? sa.bytes() : sizeof(int) * m));
+
+        // add: each entry is read once and written once
+        t0 = startup_clock::now();
+        CUdeviceptr bi = d_bi.get(), bv = d_bv.get(), ci = d_ci.get();
+        int nb = sb.nnz(), slots = nb;
+        if (both) {
+            CUdeviceptr ai = d_ai.get(), av = d_av.get(), cv = d_cv.get();
+            int na = sa.nnz();
+            slots = na + nb;
+            void *args[] = { &ai, &av, &na, &bi, &bv, &nb, &ci, &cv };
+            launchOver(sumSparseSparse, (slots + SPARSE_ITEMS - 1) / SPARSE_ITEMS, args);
+            times->kernelBytes += 2.0 * (sa.bytes() + sb.bytes());
+        } else {
+            void *args[] = { &bi, &bv, &nb, &ci };
+            launchOver(sumSparseDense, nb, args);
+            times->kernelBytes += 2.0 * sb.bytes();
+        }
+        checkCudaErrors( drv.cuStreamSynchronize(0) );
+        times->kernelMs += elapsedMs(t0);
+
+        // copy results to host
+        t0 = startup_clock::now();
+        if (!both) {
+            checkCudaErrors( copyToHost(c.subspan(offset, m), d_ci.span().first(m)) );
+            times->dtohMs += elapsedMs(t0);
+            times->dtohBytes += sizeof(int) * (double)m;
+            continue;
+        }
+        slotIndex.resize(slots);
+        slotValue.resize(slots);
+        if (slots > 0) {
+            checkCudaErrors( copyToHost(host_span<int>(slotIndex.data(), slots),
+                                        d_ci.span().first(slots)) );
+            checkCudaErrors( copyToHost(host_span<int>(slotValue.data(), slots),
+                                        d_cv.span().first(slots)) );
+        }
+        times->dtohMs += elapsedMs(t0);
+        times->dtohBytes += 2.0 * sizeof(int) * slots;
+        t0 = startup_clock::now();
+        compactSparse(slotIndex.data(), slotValue.data(), slots, m, &sc);
+        toDense(sc, c.data() + offset);
+        times->encodeMs += elapsedMs(t0);
+    }
+
+    d_ai.reset();
+    d_av.reset();
+    d_bi.reset();
+    d_bv.reset();
+    d_ci.reset();
+    d_cv.reset();
+    admission.release(sparseJobBytes(chunk, both));
+    return (n + chunk - 1) / chunk;
 }
 
-void runKernel(CUdeviceptr d_a, CUdeviceptr d_b, CUdeviceptr d_c, int n)
+// The device part of a job, packed, sparse or plain. Packed and sparse
+// jobs are not checked on the device, since a and b never exist there in
+// full.
+int runDeviceJob(host_span<const int> a, host_span<const int> b, host_span<int> c,
+                 PhaseTimes *times, VerifyResult *verify)
 {
-    void *args[] = { &d_a, &d_b, &d_c ,&n};
-    int block_size;
-    checkCudaErrors(cuDeviceGetAttribute(&block_size, CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_X, device));
+    if (sparseDensityB > 0)
+        return runSparseOnDevice(a, b, c, times);
+    if (packInputs)
+        return runPackedOnDevice(a, b, c, times);
+    return runOnDevice(a, b, c, times, verify);
+}
 
-    checkCudaErrors( cuLaunchKernel(function, 
-                                    (n+block_size-1)/block_size, 1, 1,  // Grid dim
-                                    block_size, 1, 1,                   // Threads dim
-                                    0, 0, args, 0) );
+// Co-execution: the device adds [0, split) while the host pool adds
+// [split, n) on a second thread, both straight into c. Returns split.
+int runSplit(const int *a, const int *b, int *c, int n, PhaseTimes *times,
+             VerifyResult *verify)
+{
+    int split = (int)(coexecSplit.deviceShare(offloadModel, n) * n + 0.5);
+    printf("# Co-executing: %d elements on the device, %d on the host\n", split, n - split);
+
+    double hostMs = 0;
+    std::thread host([&] {
+        startup_clock::time_point t0 = startup_clock::now();
+        hostPool.add(a + split, b + split, c + split, n - split);
+        hostMs = elapsedMs(t0);
+    });
+    startup_clock::time_point t0 = startup_clock::now();
+    if (split > 0)
+        runDeviceJob(host_span<const int>(a, split), host_span<const int>(b, split),
+                     host_span<int>(c, split), times, verify);
+    double deviceMs = elapsedMs(t0);
+    host.join();
+
+    printf("# Device side %.3f ms, host side %.3f ms\n", deviceMs, hostMs);
+    times->hostMs = hostMs;
+    coexecSplit.observe(split, deviceMs, n - split, hostMs);
+    return split;
 }
 
 int main(int argc, char **argv)
 {
-    int n = N;
-    int a[n], b[n], c[n];
-    CUdeviceptr d_a, d_b, d_c;
+    int n = (argc > 1) ? atoi(argv[1]) : N;
+    int *a, *b, *c;
+    // VADD_VERIFY=device checks device results where they are,
+    // VADD_VERIFY=sample checks chunk boundaries and a random sample
+    const char *verifyMode = getenv("VADD_VERIFY") ? getenv("VADD_VERIFY") : "";
+    bool deviceVerify = strcmp(verifyMode, "device") == 0;
+    bool sampleVerify = strcmp(verifyMode, "sample") == 0;
+    packInputs = getenv("VADD_COMPRESS") && atoi(getenv("VADD_COMPRESS")) != 0;
+    // VADD_SPARSE=<density> keeps that share of b non-zero and sends it
+    // sparse, VADD_SPARSE_A=<density> does the same for a
+    sparseDensityB = getenv("VADD_SPARSE") ? atof(getenv("VADD_SPARSE")) : 0;
+    sparseDensityA = getenv("VADD_SPARSE_A") ? atof(getenv("VADD_SPARSE_A")) : 0;
+    if (sparseDensityA > 0 && sparseDensityB <= 0) {
+        printf("# VADD_SPARSE_A needs VADD_SPARSE; a stays dense\n");
+        sparseDensityA = 0;
+    }
+    if (sparseDensityB > 0 && packInputs) {
+        printf("# Sparse inputs are not packed\n");
+        packInputs = false;
+    }
+    if ((packInputs || sparseDensityB > 0) && deviceVerify) {
+        printf("# %s inputs are verified on the host\n", packInputs ? "Packed" : "Sparse");
+        deviceVerify = false;
+    }
 
-    // initialize host arrays
-    for (int i = 0; i < n; ++i) {
-        a[i] = n - i;
-        b[i] = i * i;
+    if (n <= 0) {
+        fprintf(stderr, "usage: %s [n]\n", argv[0]);
+        return -1;
+    }
+
+    // the codec needs no device, so check it before starting one
+    if (packInputs) {
+        int failed = packSelfCheck();
+        if (failed) {
+            printf("*** Pack codec self-check: %d cases failed.\n", failed);
+            return -1;
+        }
+        printf("# Pack codec self-check passed.\n");
     }
 
-    // initialize
+    // initialize in the background
     printf("- Initializing...\n");
-    initCUDA();
+    beginInitCUDA();
 
-    // allocate memory
-    setupDeviceMemory(&d_a, &d_b, &d_c, n);
+    // initialize host arrays while the driver starts up
+    a = (int*) malloc(sizeof(int) * n);
+    b = (int*) malloc(sizeof(int) * n);
+    c = (int*) malloc(sizeof(int) * n);
+    // a sparse input is non-zero every 1/density elements
+    int strideA = sparseDensityA > 0 ? std::max(1, (int)(1 / sparseDensityA + 0.5)) : 1;
+    int strideB = sparseDensityB > 0 ? std::max(1, (int)(1 / sparseDensityB + 0.5)) : 1;
+    for (int i = 0; i < n; ++i) {
+        a[i] = (i % strideA == 0) ? inputA(i, n) : 0;
+        b[i] = (i % strideB == 0) ? inputB(i) : 0;
+    }
 
-    // copy arrays to device
-    checkCudaErrors( cuMemcpyHtoD(d_a, a, sizeof(int) * n) );
-    checkCudaErrors( cuMemcpyHtoD(d_b, b, sizeof(int) * n) );
+    // wait for the driver before touching device memory
+    joinInitCUDA();
 
-    // run
-    printf("# Running the kernel...\n");
-    runKernel(d_a, d_b, d_c, n);
-    printf("# Kernel complete.\n");
+    // run where the offload model predicts the job finishes first
+    OffloadRoute route = routeJob(n);
+    PhaseTimes times = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    int hostSlices = 1;                 // threads the host part was spread over
+    VerifyResult verify = { 0, VERIFY_NO_MISMATCH };
+    int deviceN = 0;
+    printf("# Predicted: host %.3f ms, device %.3f ms",
+           offloadModel.predictHost(n), offloadModel.predictDevice(n));
+    if (coexec)
+        printf(", split %.3f ms",
+               offloadModel.predictSplit(n, coexecSplit.deviceShare(offloadModel, n)));
+    printf("\n");
+    if (route == ROUTE_HOST) {
+        bool pooled = offloadModel.usePool(n);
+        printf("# %d elements: adding on the host%s\n", n, pooled ? " (thread pool)" : "");
+        startup_clock::time_point t0 = startup_clock::now();
+        hostPool.add(a, b, c, n, pooled ? 0 : 1);
+        times.hostMs = elapsedMs(t0);
+        hostSlices = pooled ? hostPool.slicesFor(n) : 1;
+        offloadModel.observeHost(n, pooled, times.hostMs);
+    } else if (route == ROUTE_SPLIT) {
+        printf("# Running the kernel alongside the host...\n");
+        deviceN = runSplit(a, b, c, n, &times, deviceVerify ? &verify : NULL);
+        hostSlices = hostPool.slicesFor(n - deviceN);
+        printf("# Kernel complete.\n");
+    } else {
+        printf("# Running the kernel...\n");
+        deviceN = n;
+        int chunks = runDeviceJob(host_span<const int>(a, n), host_span<const int>(b, n),
+                                  host_span<int>(c, n), &times, deviceVerify ? &verify : NULL);
+        if (chunks == 1 && !deviceVerify && !packInputs && sparseDensityB <= 0)
+            offloadModel.observeDevice(n, times.htodMs, times.kernelMs, times.dtohMs);
+        printf("# Kernel complete.\n");
+    }
 
-    // copy results to host and report
-    checkCudaErrors( cuMemcpyDtoH(c, d_c, sizeof(int) * n) );
-    for (int i = 0; i < n; ++i) {
-        if (c[i] != a[i] + b[i])
-            printf("* Error at array position %d: Expected %d, Got %d\n",
-                   i, a[i]+b[i], c[i]);
+    // report; elements checked on the device are not on the host
+    int hostBegin = deviceVerify ? deviceN : 0;
+    if (verify.mismatches)
+        printf("* %u errors on the device, first at array position %u\n",
+               verify.mismatches, verify.firstIndex);
+    startup_clock::time_point t0 = startup_clock::now();
+    if (sampleVerify) {
+        std::vector<long long> boundaries;
+        for (long long offset = 0; offset < deviceN; offset += times.chunk)
+            addBoundary(&boundaries, offset, std::min(offset + times.chunk, (long long)deviceN));
+        addBoundary(&boundaries, deviceN, n);
+        long long samples = getenv("VADD_VERIFY_SAMPLES") ? atoll(getenv("VADD_VERIFY_SAMPLES"))
+                                                          : VERIFY_SAMPLES;
+        uint64_t seed = getenv("VADD_VERIFY_SEED") ? strtoull(getenv("VADD_VERIFY_SEED"), NULL, 0)
+                                                   : (uint64_t)startup_clock::now().time_since_epoch().count();
+        printSampleReport(verifySample(a, b, c, n, boundaries, samples, seed), n);
+    } else {
+        for (int i = hostBegin; i < n; ++i) {
+            if (c[i] != a[i] + b[i])
+                printf("* Error at array position %d: Expected %d, Got %d\n",
+                       i, a[i]+b[i], c[i]);
+        }
     }
+    double verifyMs = elapsedMs(t0);
     printf("*** All checks complete.\n");
 
+    double bytes = sizeof(int) * (double)n;
+    printf("> Bandwidth per phase:\n");
+    if (deviceN < n)
+        roofline.report("hostadd", hostSlices > 1 ? PEAK_HOST_POOL : PEAK_HOST,
+                        3 * (bytes - sizeof(int) * (double)deviceN), times.hostMs);
+    if (deviceN > 0) {
+        double deviceBytes = sizeof(int) * (double)deviceN;
+        if (packInputs) {
+            printf("  Inputs packed %.0f -> %.0f bytes (%.2fx)\n", 2 * deviceBytes,
+                   times.htodBytes, 2 * deviceBytes / std::max(times.htodBytes, 1.0));
+            roofline.report("encode", PEAK_HOST, 2 * deviceBytes, times.encodeMs);
+        }
+        if (sparseDensityB > 0) {
+            printf("  Inputs sent sparse %.0f -> %.0f bytes (%.2fx)\n", 2 * deviceBytes,
+                   times.htodBytes, 2 * deviceBytes / std::max(times.htodBytes, 1.0));
+            roofline.report("encode", PEAK_HOST, 2 * deviceBytes, times.encodeMs);
+        }
+        roofline.report("htod", PEAK_LINK, times.htodBytes, times.htodMs);
+        roofline.report("kernel", PEAK_DRAM, times.kernelBytes, times.kernelMs);
+        if (deviceVerify)
+            roofline.report("dverify", PEAK_DRAM, 3 * deviceBytes, times.verifyMs);
+        else
+            roofline.report("dtoh", PEAK_LINK, times.dtohBytes, times.dtohMs);
+    }
+    if (sampleVerify)
+        printf("  %-8s %10.3f ms (sampled)\n", "verify", verifyMs);
+    else if (hostBegin < n)
+        roofline.report("verify", PEAK_HOST, 3 * (bytes - sizeof(int) * (double)hostBegin), verifyMs);
+
     // finish
     printf("- Finalizing...\n");
-    releaseDeviceMemory(d_a, d_b, d_c);
+    free(a);
+    free(b);
+    free(c);
     finalizeCUDA();
     return 0;
 }
@@ -0,0 +1,225 @@
+/*
+ * Vector addition on the host, for jobs too small to be worth a device
+ * round trip.
+ *
+ * Sizes up to SMALL_N_FIXED, and the powers of two up to SMALL_N_MAX, have
+ * their own fully unrolled specialisation: the element count is a template
+ * parameter, so the compiler emits straight-line loads, adds and stores
+ * with no loop or bounds check. hostAdd() picks the specialisation for n,
+ * or falls back to a plain loop for any other size.
+ *
+ * Larger jobs can be spread over a HostAddPool: the range is cut into
+ * contiguous slices of at least HOST_ADD_GRAIN elements, each added by a
+ * loop over restrict-qualified pointers that the compiler vectorises, and
+ * the calling thread works on one slice itself.
+ *
+ * Whether a job runs here at all is decided by the offload cost model
+ * (cost_model.h).
+ */
+
+#ifndef HOST_ADD_H
+#define HOST_ADD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define SMALL_N_FIXED 16        // every size 0..16 is specialised
+#define SMALL_N_MAX   256       // largest specialised power of two
+#define HOST_ADD_GRAIN 16384    // smallest slice worth a thread
+
+// c[I..N) = a[I..N) + b[I..N), one statement per element.
+template <int I, int N>
+struct UnrolledAdd {
+    static inline void run(const int *a, const int *b, int *c)
+    {
+        c[I] = a[I] + b[I];
+        UnrolledAdd<I + 1, N>::run(a, b, c);
+    }
+};
+
+template <int N>
+struct UnrolledAdd<N, N> {
+    static inline void run(const int *, const int *, int *) {}
+};
+
+template <int N>
+inline void addFixed(const int *a, const int *b, int *c)
+{
+    UnrolledAdd<0, N>::run(a, b, c);
+}
+
+typedef void (*FixedAdd)(const int *a, const int *b, int *c);
+
+static const FixedAdd fixedAdds[SMALL_N_FIXED + 1] = {
+    addFixed<0>,  addFixed<1>,  addFixed<2>,  addFixed<3>,
+    addFixed<4>,  addFixed<5>,  addFixed<6>,  addFixed<7>,
+    addFixed<8>,  addFixed<9>,  addFixed<10>, addFixed<11>,
+    addFixed<12>, addFixed<13>, addFixed<14>, addFixed<15>,
+    addFixed<16>,
+};
+
+// No aliasing between the three arrays, so this loop vectorises.
+inline void hostAddRange(const int *__restrict__ a, const int *__restrict__ b,
+                         int *__restrict__ c, int n)
+{
+    for (int i = 0; i < n; ++i)
+        c[i] = a[i] + b[i];
+}
+
+inline void hostAdd(const int *a, const int *b, int *c, int n)
+{
+    if (n >= 0 && n <= SMALL_N_FIXED) {
+        fixedAdds[n](a, b, c);
+        return;
+    }
+    switch (n) {
+    case 32:  addFixed<32>(a, b, c);  return;
+    case 64:  addFixed<64>(a, b, c);  return;
+    case 128: addFixed<128>(a, b, c); return;
+    case 256: addFixed<256>(a, b, c); return;
+    }
+    hostAddRange(a, b, c, n);
+}
+
+// Fixed set of worker threads that split one add at a time between them.
+class HostAddPool {
+public:
+    HostAddPool() : workerCount(0), nextSlice(0), generation(0), remaining(0), stopping(false) {}
+    ~HostAddPool() { stop(); }
+
+    // threads includes the caller, so threads - 1 workers are started.
+    void start(int threads)
+    {
+        stop();
+        stopping = false;
+        workerCount = threads > 1 ? threads - 1 : 0;
+        for (int i = 0; i < workerCount; ++i)
+            workers.push_back(std::thread(&HostAddPool::work, this));
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+        workers.clear();
+        workerCount = 0;
+    }
+
+    int threads() const { return workerCount + 1; }
+
+    // Slices for n elements: one per HOST_ADD_GRAIN, at most threads().
+    int slicesFor(int n) const
+    {
+        int slices = (n + HOST_ADD_GRAIN - 1) / HOST_ADD_GRAIN;
+        return slices < threads() ? slices : threads();
+    }
+
+    // c = a + b in `slices` pieces (0: slicesFor(n)); returns when done.
+    // One add at a time: concurrent callers are serialised.
+    void add(const int *a, const int *b, int *c, int n, int slices = 0)
+    {
+        if (slices <= 0)
+            slices = slicesFor(n);
+        if (slices <= 1 || workerCount == 0) {
+            hostAdd(a, b, c, n);
+            return;
+        }
+
+        std::lock_guard<std::mutex> serial(callMutex);
+        Job mine;
+        unsigned long long gen;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job.a = a;
+            job.b = b;
+            job.c = c;
+            job.n = n;
+            job.slices = slices;
+            remaining = slices;
+            gen = ++generation;
+            nextSlice = slotTag(gen);
+            mine = job;
+        }
+        wake.notify_all();
+        runSlices(mine, gen);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return remaining == 0; });
+    }
+
+private:
+    struct Job {
+        const int *a, *b;
+        int       *c;
+        int        n, slices;
+    };
+
+    // nextSlice holds the job's generation in its upper half and the next
+    // unclaimed slice in its lower half, so a thread still holding an
+    // earlier job can neither claim nor count a slice of the current one.
+    static unsigned long long slotTag(unsigned long long gen) { return gen << 32; }
+
+    bool claimSlice(unsigned long long gen, int slices, int *s)
+    {
+        unsigned long long next = nextSlice.load();
+        do {
+            if ((next >> 32) != (gen & 0xffffffffULL) || (int)(next & 0xffffffffULL) >= slices)
+                return false;
+        } while (!nextSlice.compare_exchange_weak(next, next + 1));
+        *s = (int)(next & 0xffffffffULL);
+        return true;
+    }
+
+    // job is the caller's own copy, taken under mutex.
+    void runSlices(const Job &job, unsigned long long gen)
+    {
+        int s;
+        while (claimSlice(gen, job.slices, &s)) {
+            long long begin = (long long)job.n * s / job.slices;
+            long long end = (long long)job.n * (s + 1) / job.slices;
+            hostAddRange(job.a + begin, job.b + begin, job.c + begin, (int)(end - begin));
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--remaining == 0)
+                done.notify_one();
+        }
+    }
+
+    void work()
+    {
+        unsigned long long seen = 0;
+        for (;;) {
+            Job mine;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+                mine = job;
+            }
+            runSlices(mine, seen);
+        }
+    }
+
+    std::vector<std::thread>        workers;
+    int                             workerCount;
+    std::mutex                      callMutex;
+    std::mutex                      mutex;
+    std::condition_variable         wake;
+    std::condition_variable         done;
+    Job                             job;
+    std::atomic<unsigned long long> nextSlice;
+    unsigned long long              generation;
+    int                             remaining;
+    bool                            stopping;
+};
+
+#endif // HOST_ADD_H
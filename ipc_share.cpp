@@ -0,0 +1,197 @@
+/*
+ * One producer computes c = a + b once; several consumer processes read c
+ * straight from device memory through CUDA IPC handles (cuda_ipc.h).
+ *
+ * The consumers are forked before the producer touches the driver, since a
+ * CUDA context does not survive fork(). Handles travel over a pipe; each
+ * consumer acknowledges on a second pipe once it has closed its mapping,
+ * after which the producer frees the buffer.
+ *
+ * Backends without IPC (the CPU fallback) send the vector itself through
+ * the pipe instead, which is the host round trip IPC avoids.
+ *
+ * Ref:
+ * https://docs.nvidia.com/cuda/cuda-driver-api/group__CUDA__MEM.html
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cuda.h>
+
+#include "cuda_helper.h"
+#include "cuda_ipc.h"
+
+#define N         10
+#define CONSUMERS 2
+
+// What the producer sends each consumer.
+struct Message {
+    int          n;
+    int          viaHost;       // 1: data follows the message
+    SharedBuffer buffer;
+};
+
+// --- functions -----------------------------------------------------------
+bool readAll(int fd, void *buf, size_t bytes)
+{
+    char *p = (char*)buf;
+    while (bytes > 0) {
+        ssize_t got = read(fd, p, bytes);
+        if (got <= 0)
+            return false;
+        p += got;
+        bytes -= got;
+    }
+    return true;
+}
+
+bool writeAll(int fd, const void *buf, size_t bytes)
+{
+    const char *p = (const char*)buf;
+    while (bytes > 0) {
+        ssize_t put = write(fd, p, bytes);
+        if (put <= 0)
+            return false;
+        p += put;
+        bytes -= put;
+    }
+    return true;
+}
+
+void runKernel(CUdeviceptr d_a, CUdeviceptr d_b, CUdeviceptr d_c, int n)
+{
+    void *args[] = { &d_a, &d_b, &d_c ,&n};
+    int block_size;
+    checkCudaErrors(drv.cuDeviceGetAttribute(&block_size, CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_X, device));
+
+    checkCudaErrors( drv.cuLaunchKernel(function,
+                                    (n+block_size-1)/block_size, 1, 1,  // Grid dim
+                                    block_size, 1, 1,                   // Threads dim
+                                    0, 0, args, 0) );
+}
+
+// Map the producer's c and check it against a + b.
+int consumer(int id, int in, int ack)
+{
+    Message msg;
+    if (!readAll(in, &msg, sizeof(msg)))
+        return -1;
+
+    int *c = (int*) malloc(sizeof(int) * msg.n);
+    if (msg.viaHost) {
+        if (!readAll(in, c, sizeof(int) * msg.n))
+            return -1;
+    } else {
+        CUdeviceptr d_c;
+        initCUDA();
+        checkCudaErrors( importDeviceBuffer(msg.buffer, &d_c) );
+        printf("# Consumer %d mapped %llu bytes of device memory\n", id, msg.buffer.bytes);
+        checkCudaErrors( drv.cuMemcpyDtoH(c, d_c, sizeof(int) * msg.n) );
+        checkCudaErrors( closeDeviceBuffer(d_c) );
+        finalizeCUDA();
+    }
+
+    int errors = 0;
+    for (int i = 0; i < msg.n; ++i) {
+        int expected = (msg.n - i) + i * i;
+        if (c[i] != expected) {
+            printf("* Consumer %d: error at array position %d: Expected %d, Got %d\n",
+                   id, i, expected, c[i]);
+            ++errors;
+        }
+    }
+    free(c);
+
+    char done = 1;
+    writeAll(ack, &done, 1);
+    return errors ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    int n = N;
+    int a[n], b[n], c[n];
+    int toConsumer[CONSUMERS][2], fromConsumer[CONSUMERS][2];
+    pid_t pids[CONSUMERS];
+
+    // consumers first: no driver state may exist at fork()
+    for (int k = 0; k < CONSUMERS; ++k) {
+        if (pipe(toConsumer[k]) != 0 || pipe(fromConsumer[k]) != 0) {
+            perror("pipe");
+            return -1;
+        }
+        pids[k] = fork();
+        if (pids[k] == 0) {
+            close(toConsumer[k][1]);
+            close(fromConsumer[k][0]);
+            return consumer(k, toConsumer[k][0], fromConsumer[k][1]);
+        }
+        close(toConsumer[k][0]);
+        close(fromConsumer[k][1]);
+    }
+
+    for (int i = 0; i < n; ++i) {
+        a[i] = n - i;
+        b[i] = i * i;
+    }
+
+    // initialize
+    printf("- Initializing...\n");
+    initCUDA();
+
+    CUdeviceptr d_a, d_b, d_c;
+    checkCudaErrors( allocDevice(&d_a, sizeof(int) * n, "input") );
+    checkCudaErrors( allocDevice(&d_b, sizeof(int) * n, "input") );
+    checkCudaErrors( allocDevice(&d_c, sizeof(int) * n, "shared") );
+    checkCudaErrors( drv.cuMemcpyHtoD(d_a, a, sizeof(int) * n) );
+    checkCudaErrors( drv.cuMemcpyHtoD(d_b, b, sizeof(int) * n) );
+
+    printf("# Running the kernel...\n");
+    runKernel(d_a, d_b, d_c, n);
+    checkCudaErrors( drv.cuStreamSynchronize(0) );
+    printf("# Kernel complete.\n");
+
+    // publish c
+    Message msg;
+    msg.n = n;
+    msg.viaHost = 0;
+    CUresult err = exportDeviceBuffer(d_c, sizeof(int) * n, &msg.buffer);
+    if (err == CUDA_ERROR_NOT_SUPPORTED) {
+        printf("> IPC is not supported by this backend; sending the data instead\n");
+        msg.viaHost = 1;
+        checkCudaErrors( drv.cuMemcpyDtoH(c, d_c, sizeof(int) * n) );
+    } else {
+        checkCudaErrors(err);
+    }
+    for (int k = 0; k < CONSUMERS; ++k) {
+        writeAll(toConsumer[k][1], &msg, sizeof(msg));
+        if (msg.viaHost)
+            writeAll(toConsumer[k][1], c, sizeof(int) * n);
+    }
+
+    // c must stay allocated until every consumer is done with it
+    bool correct = true;
+    for (int k = 0; k < CONSUMERS; ++k) {
+        char done;
+        int status;
+        readAll(fromConsumer[k][0], &done, 1);
+        waitpid(pids[k], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            correct = false;
+    }
+    if (correct) {
+        printf("*** All checks complete.\n");
+    } else {
+        printf("*** Result incorrect.\n");
+    }
+
+    // finish
+    printf("- Finalizing...\n");
+    checkCudaErrors( freeDevice(d_a) );
+    checkCudaErrors( freeDevice(d_b) );
+    checkCudaErrors( freeDevice(d_c) );
+    finalizeCUDA();
+    return 0;
+}
@@ -1,5 +1,8 @@
 // Vector addition (device code)
 
+#include "pack_format.h"
+#include "sparse_format.h"
+
 // extern C for host program load correct function name
 extern "C" __global__ void Sum(int *a, int *b, int *c, int n)
 {
@@ -7,3 +10,137 @@ extern "C" __global__ void Sum(int *a, int *b, int *c, int n)
     if (tid < n)
         c[tid] = a[tid] + b[tid];
 }
+
+// Verification on the device: result[0] counts the elements of c that
+// differ from a + b (Verify) or from a reference buffer (VerifyRef), and
+// result[1], which starts at 0xffffffff, receives the first such index.
+// Only mismatching threads touch the result, so a correct c costs no
+// atomics.
+extern "C" __global__ void Verify(int *a, int *b, int *c, int n, unsigned int *result)
+{
+    int tid = threadIdx.x + blockIdx.x * blockDim.x;
+    if (tid < n && c[tid] != a[tid] + b[tid]) {
+        atomicAdd(&result[0], 1u);
+        atomicMin(&result[1], (unsigned int)tid);
+    }
+}
+
+extern "C" __global__ void VerifyRef(int *ref, int *c, int n, unsigned int *result)
+{
+    int tid = threadIdx.x + blockIdx.x * blockDim.x;
+    if (tid < n && c[tid] != ref[tid]) {
+        atomicAdd(&result[0], 1u);
+        atomicMin(&result[1], (unsigned int)tid);
+    }
+}
+
+// Slot s of a packed block (pack_format.h).
+__device__ unsigned int unpackSlot(const unsigned int *words, const PackHeader &h, int s)
+{
+    if (h.width == 0)
+        return 0;
+    unsigned int bit = (unsigned int)s * h.width;
+    unsigned int word = h.offset + bit / 32, shift = bit % 32;
+    unsigned int v = words[word] >> shift;
+    if (shift + h.width > 32)
+        v |= words[word + 1] << (32 - shift);
+    return h.width == 32 ? v : v & ((1u << h.width) - 1);
+}
+
+// Value of slot s of this CUDA block's pack block. Delta blocks are rebuilt
+// with an inclusive scan of the steps in shared memory; the codec is the
+// same for the whole CUDA block, so every thread reaches the barriers.
+__device__ int decodePacked(const PackHeader *headers, const unsigned int *words, int s,
+                            unsigned int *scan)
+{
+    PackHeader h = headers[blockIdx.x];
+    unsigned int slot = unpackSlot(words, h, s);
+    if (h.codec == PACK_FOR)
+        return (int)((unsigned int)h.base + slot);
+
+    scan[s] = (s == 0) ? (unsigned int)h.first : (unsigned int)h.base + slot;
+    __syncthreads();
+    for (int d = 1; d < PACK_BLOCK; d <<= 1) {
+        unsigned int add = (s >= d) ? scan[s - d] : 0;
+        __syncthreads();
+        scan[s] += add;
+        __syncthreads();
+    }
+    return (int)scan[s];
+}
+
+// c = a + b with a and b packed (pack_codec.h): decoded straight from the
+// packed words, never stored unpacked. Launch with one block of PACK_BLOCK
+// threads per pack block.
+extern "C" __global__ void SumPacked(PackHeader *ha, unsigned int *wa,
+                                     PackHeader *hb, unsigned int *wb, int *c, int n)
+{
+    __shared__ unsigned int scan[PACK_BLOCK];
+    int s = threadIdx.x;
+    int tid = blockIdx.x * PACK_BLOCK + s;
+    int a = decodePacked(ha, wa, s, scan);
+    __syncthreads();        // scan is reused for b
+    int b = decodePacked(hb, wb, s, scan);
+    if (tid < n)
+        c[tid] = a + b;
+}
+
+// c += b for a sparse b (sparse_format.h): c arrives holding a, and only
+// b's nnz entries are read or written. Indices are distinct, so no two
+// threads write the same element.
+extern "C" __global__ void SumSparseDense(int *index, int *value, int nnz, int *c)
+{
+    int tid = threadIdx.x + blockIdx.x * blockDim.x;
+    if (tid < nnz)
+        c[index[tid]] += value[tid];
+}
+
+// Merge path search, as mergePathSplit() in sparse_vector.h: how many of
+// the first diag merged slots come from a, equal indices taking a first.
+__device__ int mergePath(const int *a, int na, const int *b, int nb, int diag)
+{
+    int lo = diag > nb ? diag - nb : 0;
+    int hi = diag < na ? diag : na;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (a[mid] <= b[diag - 1 - mid])
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// c = a + b for sparse a and b: thread t writes merged slots
+// [t * SPARSE_ITEMS, (t + 1) * SPARSE_ITEMS) of the na + nb, starting where
+// the merge path search places it. An entry of a picks up the b entry with
+// the same index, which comes next in b; that b entry, whichever thread
+// reaches it, sees the same index just before it in a and writes a
+// tombstone.
+extern "C" __global__ void SumSparseSparse(int *aIndex, int *aValue, int na,
+                                           int *bIndex, int *bValue, int nb,
+                                           int *cIndex, int *cValue)
+{
+    int tid = threadIdx.x + blockIdx.x * blockDim.x;
+    int begin = tid * SPARSE_ITEMS;
+    if (begin >= na + nb)
+        return;
+    int end = min(begin + SPARSE_ITEMS, na + nb);
+    int i = mergePath(aIndex, na, bIndex, nb, begin), j = begin - i;
+
+    for (int k = begin; k < end; ++k) {
+        if (j >= nb || (i < na && aIndex[i] <= bIndex[j])) {
+            int v = aValue[i];
+            if (j < nb && bIndex[j] == aIndex[i])
+                v += bValue[j];
+            cIndex[k] = aIndex[i];
+            cValue[k] = v;
+            ++i;
+        } else {
+            bool duplicate = i > 0 && aIndex[i - 1] == bIndex[j];
+            cIndex[k] = duplicate ? SPARSE_TOMBSTONE : bIndex[j];
+            cValue[k] = duplicate ? 0 : bValue[j];
+            ++j;
+        }
+    }
+}
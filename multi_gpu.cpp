@@ -0,0 +1,123 @@
+/* 
+ * Two-stage pipeline across devices: c = a + b is computed on device 0 and
+ * consumed on device 1 (e = c + b), with the intermediate vectors moved
+ * device to device through cuda_peer.h instead of through the host.
+ *
+ * With a single device both stages run on device 0. On the CPU backend,
+ * VADD_CPU_DEVICES=2 simulates two devices and VADD_PEER_TOPOLOGY=none
+ * forces the staged path.
+ *
+ * Ref:
+ * https://docs.nvidia.com/cuda/cuda-driver-api
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cuda.h>
+
+#include "cuda_handles.h"
+#include "cuda_peer.h"
+
+#define N 10
+
+// --- functions -----------------------------------------------------------
+void launchSum(CUfunction f, CUdevice dev, CUdeviceptr d_a, CUdeviceptr d_b, CUdeviceptr d_c, int n)
+{
+    void *args[] = { &d_a, &d_b, &d_c, &n };
+    int block_size;
+    checkCudaErrors(drv.cuDeviceGetAttribute(&block_size, CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_X, dev));
+
+    checkCudaErrors( drv.cuLaunchKernel(f,
+                                        (n+block_size-1)/block_size, 1, 1,  // Grid dim
+                                        block_size, 1, 1,                   // Threads dim
+                                        0, 0, args, 0) );
+}
+
+int main(int argc, char **argv)
+{
+    int n = N;
+    int a[n], b[n], e[n];
+    size_t bytes = sizeof(int) * n;
+    PeerTopology topology;
+
+    for (int i = 0; i < n; ++i) {
+        a[i] = n - i;
+        b[i] = i * i;
+    }
+
+    // initialize
+    printf("- Initializing...\n");
+    initCUDA();
+
+    std::vector<CUdevice>  devs;
+    std::vector<CUcontext> ctxs;
+    for (size_t i = 0; i < devices.size(); ++i) {
+        devs.push_back(devices[i].device);
+        ctxs.push_back(devices[i].context.get());
+    }
+    checkCudaErrors( topology.init(devs, ctxs) );
+    topology.print();
+
+    int consumer = devices.size() > 1 ? 1 : 0;
+    printf("> Producer: device 0, consumer: device %d (%s)\n", consumer,
+           topology.canAccess(consumer, 0) && topology.canAccess(0, consumer) ?
+           "peer copy" : "staged copy");
+
+    {
+        // each owner gives its buffer or module back at the end of this
+        // scope, in the context it came from
+        DeviceBuffer<int> d_a, d_b, d_c;    // producer, device 0
+        PeerBuffer<int>   p_b, p_c, p_e;    // consumer
+        Module            consumerModule;
+        CUfunction        consumerFunction;
+
+        // stage 1 on device 0
+        checkCudaErrors( drv.cuCtxSetCurrent(devices[0].context.get()) );
+        checkCudaErrors( d_a.allocate(n, "input") );
+        checkCudaErrors( d_b.allocate(n, "input") );
+        checkCudaErrors( d_c.allocate(n, "output") );
+        checkCudaErrors( drv.cuMemcpyHtoD(d_a.get(), a, bytes) );
+        checkCudaErrors( drv.cuMemcpyHtoD(d_b.get(), b, bytes) );
+        printf("# Running stage 1 on device 0...\n");
+        launchSum(function, devices[0].device, d_a.get(), d_b.get(), d_c.get(), n);
+        checkCudaErrors( drv.cuStreamSynchronize(0) );
+
+        // stage 2 on the consumer, which needs its own copy of the module
+        checkCudaErrors( drv.cuCtxSetCurrent(devices[consumer].context.get()) );
+        checkCudaErrors( consumerModule.load(module_file) );
+        checkCudaErrors( consumerModule.getFunction(&consumerFunction, kernel_name) );
+        checkCudaErrors( p_b.allocate(n) );
+        checkCudaErrors( p_c.allocate(n) );
+        checkCudaErrors( p_e.allocate(n) );
+
+        printf("# Moving intermediates to device %d...\n", consumer);
+        checkCudaErrors( topology.copyPeer(p_c.get(), consumer, d_c.get(), 0, bytes, 0) );
+        checkCudaErrors( topology.copyPeer(p_b.get(), consumer, d_b.get(), 0, bytes, 0) );
+
+        printf("# Running stage 2 on device %d...\n", consumer);
+        launchSum(consumerFunction, devices[consumer].device, p_c.get(), p_b.get(), p_e.get(), n);
+        checkCudaErrors( drv.cuMemcpyDtoH(e, p_e.get(), bytes) );
+        printf("# Pipeline complete.\n");
+        checkCudaErrors( drv.cuCtxSetCurrent(devices[0].context.get()) );
+    }
+
+    // report
+    bool correct = true;
+    for (int i = 0; i < n; ++i) {
+        if (e[i] != a[i] + 2 * b[i]) {
+            printf("* Error at array position %d: Expected %d, Got %d\n",
+                   i, a[i] + 2 * b[i], e[i]);
+            correct = false;
+        }
+    }
+    if (correct) {
+        printf("*** All checks complete.\n");
+    } else {
+        printf("*** Result incorrect.\n");
+    }
+
+    // finish
+    printf("- Finalizing...\n");
+    finalizeCUDA();
+    return 0;
+}
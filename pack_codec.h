@@ -0,0 +1,313 @@
+/*
+ * Lightweight compression of int vectors for the host -> device copy.
+ *
+ * packVector() codes each block of PACK_BLOCK elements (pack_format.h) as
+ * frame of reference plus bit packing, or as deltas packed the same way,
+ * whichever needs fewer bits; ties go to FOR, which decodes without a
+ * scan. Small-range data packs to the width of its range, monotone or
+ * arithmetic data (a[i] = n - i) to the width of its step, down to 0 bits
+ * plus the 16-byte header per block.
+ *
+ * The min/max pass is a plain loop over a restrict-qualified pointer that
+ * the compiler vectorises; the bit packing runs through a 64-bit
+ * accumulator, specialised per width so the shifts are constants.
+ * unpackVector() is the reference decoder: the CPU backend's build of the
+ * SumPacked kernel decodes with it, and it needs no device at all.
+ *
+ * packSelfCheck() round-trips the edge cases of the format through both:
+ * width 0, width 32, negative steps and a short last block. A wrong width
+ * would otherwise only show up as mismatches in a full run.
+ */
+
+#ifndef PACK_CODEC_H
+#define PACK_CODEC_H
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "pack_format.h"
+
+struct PackedVector {
+    std::vector<PackHeader>   headers;
+    std::vector<unsigned int> words;
+    int                       n;
+
+    PackedVector() : n(0) {}
+
+    size_t bytes() const
+    {
+        return headers.size() * sizeof(PackHeader) + words.size() * sizeof(unsigned int);
+    }
+};
+
+inline int packBlocks(int n)
+{
+    return (n + PACK_BLOCK - 1) / PACK_BLOCK;
+}
+
+// Bits needed for values 0..range.
+inline unsigned int packWidth(unsigned int range)
+{
+    unsigned int w = 0;
+    while (w < 32 && (range >> w) != 0)
+        ++w;
+    return w;
+}
+
+// Value and step ranges of v[0..m) in one pass; the loop has no stores
+// and no aliasing, so it vectorises. Steps wrap modulo 2^32.
+inline void blockRanges(const int *__restrict__ v, int m, int *lo, int *hi, int *dlo, int *dhi)
+{
+    int mn = v[0], mx = v[0];
+    int dmn = 0, dmx = 0;
+    if (m > 1)
+        dmn = dmx = (int)((unsigned int)v[1] - (unsigned int)v[0]);
+    for (int i = 1; i < m; ++i) {
+        int d = (int)((unsigned int)v[i] - (unsigned int)v[i - 1]);
+        mn = v[i] < mn ? v[i] : mn;
+        mx = v[i] > mx ? v[i] : mx;
+        dmn = d < dmn ? d : dmn;
+        dmx = d > dmx ? d : dmx;
+    }
+    *lo = mn;
+    *hi = mx;
+    *dlo = dmn;
+    *dhi = dmx;
+}
+
+// PACK_BLOCK slots of W bits into W * PACK_BLOCK / 32 words. Slots are
+// shifted into an accumulator and a word goes out whenever 32 bits are in;
+// W is a template parameter so that the compiler can unroll and fold it.
+template <unsigned int W>
+inline void packFixed(const unsigned int *__restrict__ slots, unsigned int *__restrict__ out)
+{
+    unsigned long long acc = 0;
+    unsigned int bits = 0;
+    for (int s = 0; s < PACK_BLOCK; ++s) {
+        acc |= (unsigned long long)slots[s] << bits;
+        bits += W;
+        if (bits >= 32) {
+            *out++ = (unsigned int)acc;
+            acc >>= 32;
+            bits -= 32;
+        }
+    }
+}
+
+template <unsigned int W>
+inline void unpackFixed(const unsigned int *__restrict__ in, unsigned int *__restrict__ slots)
+{
+    const unsigned long long mask = (1ULL << W) - 1;
+    unsigned long long acc = 0;
+    unsigned int bits = 0;
+    for (int s = 0; s < PACK_BLOCK; ++s) {
+        if (bits < W) {
+            acc |= (unsigned long long)*in++ << bits;
+            bits += 32;
+        }
+        slots[s] = (unsigned int)(acc & mask);
+        acc >>= W;
+        bits -= W;
+    }
+}
+
+typedef void (*PackFn)(const unsigned int *slots, unsigned int *out);
+typedef void (*UnpackFn)(const unsigned int *in, unsigned int *slots);
+
+#define PACK_WIDTHS(X) \
+    X(1)  X(2)  X(3)  X(4)  X(5)  X(6)  X(7)  X(8)  X(9)  X(10) X(11) \
+    X(12) X(13) X(14) X(15) X(16) X(17) X(18) X(19) X(20) X(21) X(22) \
+    X(23) X(24) X(25) X(26) X(27) X(28) X(29) X(30) X(31) X(32)
+
+// Indexed by width; width 0 has no packed bits at all.
+#define X(w) packFixed<w>,
+static const PackFn packFns[33] = { NULL, PACK_WIDTHS(X) };
+#undef X
+#define X(w) unpackFixed<w>,
+static const UnpackFn unpackFns[33] = { NULL, PACK_WIDTHS(X) };
+#undef X
+
+inline void packBlock(const int *v, int m, PackedVector *out)
+{
+    unsigned int slots[PACK_BLOCK];
+    int          lo, hi, dlo, dhi;
+
+    blockRanges(v, m, &lo, &hi, &dlo, &dhi);
+    unsigned int forWidth = packWidth((unsigned int)hi - (unsigned int)lo);
+    unsigned int deltaWidth = packWidth((unsigned int)dhi - (unsigned int)dlo);
+
+    PackHeader h;
+    memset(&h, 0, sizeof(h));
+    h.offset = (unsigned int)out->words.size();
+    if (deltaWidth < forWidth) {
+        h.codec = PACK_DELTA;
+        h.width = (unsigned char)deltaWidth;
+        h.base = dlo;
+        h.first = v[0];
+        slots[0] = 0;
+        for (int i = 1; i < m; ++i)
+            slots[i] = (unsigned int)v[i] - (unsigned int)v[i - 1] - (unsigned int)dlo;
+    } else {
+        h.codec = PACK_FOR;
+        h.width = (unsigned char)forWidth;
+        h.base = lo;
+        for (int i = 0; i < m; ++i)
+            slots[i] = (unsigned int)v[i] - (unsigned int)lo;
+    }
+    // a short last block is padded with zero slots, never read back
+    for (int i = m; i < PACK_BLOCK; ++i)
+        slots[i] = 0;
+
+    out->headers.push_back(h);
+    if (h.width == 0)
+        return;
+    size_t start = out->words.size();
+    out->words.resize(start + (size_t)h.width * PACK_BLOCK / 32, 0);
+    packFns[h.width](slots, out->words.data() + start);
+}
+
+inline void packVector(const int *v, int n, PackedVector *out)
+{
+    out->n = n;
+    out->headers.clear();
+    out->words.clear();
+    out->headers.reserve(packBlocks(n));
+    out->words.reserve((size_t)packBlocks(n) * PACK_BLOCK);
+    for (int offset = 0; offset < n; offset += PACK_BLOCK)
+        packBlock(v + offset, n - offset < PACK_BLOCK ? n - offset : PACK_BLOCK, out);
+}
+
+// The first m values of one block.
+inline void unpackBlock(const PackHeader &h, const unsigned int *words, int m, int *out)
+{
+    unsigned int slots[PACK_BLOCK];
+    if (h.width == 0)
+        memset(slots, 0, sizeof(slots));
+    else
+        unpackFns[h.width](words + h.offset, slots);
+
+    if (h.codec == PACK_DELTA) {
+        unsigned int v = (unsigned int)h.first;
+        out[0] = (int)v;
+        for (int s = 1; s < m; ++s) {
+            v += (unsigned int)h.base + slots[s];
+            out[s] = (int)v;
+        }
+    } else {
+        for (int s = 0; s < m; ++s)
+            out[s] = (int)((unsigned int)h.base + slots[s]);
+    }
+}
+
+inline void unpackVector(const PackedVector &in, int *out)
+{
+    for (size_t b = 0; b < in.headers.size(); ++b) {
+        int offset = (int)b * PACK_BLOCK;
+        int m = in.n - offset < PACK_BLOCK ? in.n - offset : PACK_BLOCK;
+        unpackBlock(in.headers[b], in.words.data(), m, out + offset);
+    }
+}
+
+// --- self-check ----------------------------------------------------------
+
+// One input of packSelfCheck() and what its first block must be coded as;
+// width -1 accepts any.
+struct PackCase {
+    const char      *name;
+    std::vector<int> v;
+    int              codec;
+    int              width;
+};
+
+// Encodes and decodes each case, printing the ones that do not come back
+// unchanged or are not coded as expected. Returns how many failed.
+inline int packSelfCheck()
+{
+    std::vector<PackCase> cases(8);
+    unsigned int x = 2463534242u;       // xorshift32 state
+    std::vector<int> noise;
+    for (int i = 0; i < 4 * PACK_BLOCK + 5; ++i) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        noise.push_back((int)x);
+    }
+
+    cases[0].name = "constant";         // FOR, width 0
+    cases[0].v.assign(PACK_BLOCK, -7);
+    cases[0].codec = PACK_FOR;
+    cases[0].width = 0;
+
+    cases[1].name = "full range";       // INT_MIN and INT_MAX in noise, width 32
+    cases[1].v.assign(noise.begin(), noise.begin() + PACK_BLOCK);
+    cases[1].v[0] = INT_MIN;
+    cases[1].v[1] = INT_MAX;
+    cases[1].codec = PACK_FOR;
+    cases[1].width = 32;
+
+    cases[2].name = "descending";       // constant negative step, width 0
+    for (int i = 0; i < 2 * PACK_BLOCK; ++i)
+        cases[2].v.push_back(1000 - 3 * i);
+    cases[2].codec = PACK_DELTA;
+    cases[2].width = 0;
+
+    cases[3].name = "negative steps";   // steps of -1..-8 around a large base
+    for (int i = 0, v = INT_MAX; i < PACK_BLOCK; ++i, v -= 1 + i % 8)
+        cases[3].v.push_back(v);
+    cases[3].codec = PACK_DELTA;
+    cases[3].width = 3;
+
+    cases[4].name = "short tail";       // last block of 37 elements
+    for (int i = 0; i < 3 * PACK_BLOCK + 37; ++i)
+        cases[4].v.push_back(i % 1000);
+    cases[4].codec = PACK_DELTA;
+    cases[4].width = 0;
+
+    cases[5].name = "single";
+    cases[5].v.assign(1, INT_MIN);
+    cases[5].codec = PACK_FOR;
+    cases[5].width = 0;
+
+    cases[6].name = "random";           // full 32-bit values, tail of 5
+    cases[6].v = noise;
+    cases[6].codec = -1;
+    cases[6].width = -1;
+
+    cases[7].name = "wrapping steps";   // INT_MIN, INT_MAX, ...: steps of +-1 mod 2^32
+    for (int i = 0; i < PACK_BLOCK; ++i)
+        cases[7].v.push_back(i % 2 ? INT_MAX : INT_MIN);
+    cases[7].codec = PACK_DELTA;
+    cases[7].width = 2;
+
+    int failed = 0;
+    for (size_t c = 0; c < cases.size(); ++c) {
+        const PackCase &pc = cases[c];
+        int n = (int)pc.v.size();
+        PackedVector packed;
+        packVector(pc.v.data(), n, &packed);
+        std::vector<int> out(n);
+        unpackVector(packed, out.data());
+
+        const PackHeader &h = packed.headers[0];
+        if ((pc.codec >= 0 && h.codec != pc.codec) || (pc.width >= 0 && h.width != pc.width)) {
+            printf("* Pack self-check %s: coded as %s width %d, expected %s width %d\n",
+                   pc.name, h.codec == PACK_DELTA ? "delta" : "FOR", h.width,
+                   pc.codec == PACK_DELTA ? "delta" : "FOR", pc.width);
+            ++failed;
+            continue;
+        }
+        for (int i = 0; i < n; ++i) {
+            if (out[i] != pc.v[i]) {
+                printf("* Pack self-check %s: position %d: Expected %d, Got %d\n",
+                       pc.name, i, pc.v[i], out[i]);
+                ++failed;
+                break;
+            }
+        }
+    }
+    return failed;
+}
+
+#endif // PACK_CODEC_H
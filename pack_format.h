@@ -0,0 +1,34 @@
+/*
+ * Layout of a packed int vector, shared by the host codec (pack_codec.h),
+ * the device kernels (kernel.cu) and their host build (kernel_host.h).
+ *
+ * The vector is cut into blocks of PACK_BLOCK elements. Each block has a
+ * PackHeader and width * PACK_BLOCK / 32 words of packed bits starting at
+ * header.offset; slot s of a block occupies bits [s * width, (s + 1) *
+ * width) of that run, least significant bit first, so a slot may straddle
+ * two words. A block is coded one of two ways:
+ *
+ *   PACK_FOR    frame of reference: value = base + slot
+ *   PACK_DELTA  value[0] = first, value[s] = value[s - 1] + base + slot[s]
+ *
+ * All arithmetic wraps modulo 2^32, so any int sequence round-trips.
+ */
+
+#ifndef PACK_FORMAT_H
+#define PACK_FORMAT_H
+
+#define PACK_BLOCK 128          // elements per block, and the decode kernel's block size
+
+#define PACK_FOR   0
+#define PACK_DELTA 1
+
+struct PackHeader {
+    int            base;        // FOR: the block minimum; delta: the smallest step
+    int            first;       // delta: the block's first value
+    unsigned int   offset;      // first word of the block's packed bits
+    unsigned char  width;       // bits per slot, 0..32
+    unsigned char  codec;       // PACK_FOR or PACK_DELTA
+    unsigned short reserved;
+};
+
+#endif // PACK_FORMAT_H
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""
+Compare a benchmark run (bench.cpp JSON) with the checked-in baseline.
+
+    perf_compare.py perf_baseline.json bench.json [--threshold 0.15] [--alpha 0.01]
+
+Each case present in both files is tested with a one-sided Mann-Whitney U
+test on the repeated samples (is the new run slower?). A case regresses
+when the test is significant at alpha AND its median time grew by more
+than threshold AND by more than --min-delta-ms, which keeps microsecond
+cases from failing on timer noise. Exits 1 if any case regressed.
+
+With --update the cases of the new run replace or extend those of the
+baseline instead, so CPU and GPU machines can each record their own cases
+into the same file.
+
+Standard library only, so it runs on CI machines without numpy/scipy.
+"""
+
+import argparse
+import json
+import math
+import statistics
+import sys
+
+
+def mann_whitney_greater(baseline, current):
+    """P-value of H1: current tends to be larger than baseline.
+
+    Normal approximation with tie correction and continuity correction;
+    adequate for the 10+ samples per side bench.cpp records.
+    """
+    n1, n2 = len(current), len(baseline)
+    pooled = sorted([(v, 0) for v in current] + [(v, 1) for v in baseline])
+
+    # average ranks over ties
+    ranks = [0.0] * len(pooled)
+    ties = 0.0
+    i = 0
+    while i < len(pooled):
+        j = i
+        while j + 1 < len(pooled) and pooled[j + 1][0] == pooled[i][0]:
+            j += 1
+        for k in range(i, j + 1):
+            ranks[k] = (i + j) / 2.0 + 1
+        t = j - i + 1
+        ties += t ** 3 - t
+        i = j + 1
+
+    r1 = sum(r for r, (_, side) in zip(ranks, pooled) if side == 0)
+    u = r1 - n1 * (n1 + 1) / 2.0
+    n = n1 + n2
+    mean = n1 * n2 / 2.0
+    var = n1 * n2 / 12.0 * ((n + 1) - ties / (n * (n - 1)))
+    if var <= 0:
+        return 1.0
+    z = (u - mean - 0.5) / math.sqrt(var)
+    return 0.5 * math.erfc(z / math.sqrt(2))
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    return {case["name"]: case for case in data["cases"]}
+
+
+def update(baseline_path, current_path):
+    try:
+        baseline = load(baseline_path)
+    except OSError:
+        baseline = {}
+    current = load(current_path)
+    baseline.update(current)
+    with open(baseline_path, "w") as f:
+        # one case per line, like bench.cpp writes them
+        f.write('{\n  "cases": [\n')
+        f.write(",\n".join("    " + json.dumps(case) for case in baseline.values()))
+        f.write("\n  ]\n}\n")
+    print("> %d case(s) of %s recorded in %s" % (len(current), current_path, baseline_path))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0].strip())
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.15,
+                        help="relative slowdown of the median that counts (default 0.15)")
+    parser.add_argument("--alpha", type=float, default=0.01,
+                        help="significance level of the test (default 0.01)")
+    parser.add_argument("--min-delta-ms", type=float, default=0.005,
+                        help="ignore median changes smaller than this (default 0.005)")
+    parser.add_argument("--update", action="store_true",
+                        help="merge the run into the baseline instead of comparing")
+    args = parser.parse_args()
+
+    try:
+        if args.update:
+            return update(args.baseline, args.current)
+        baseline = load(args.baseline)
+        current = load(args.current)
+    except (OSError, ValueError, KeyError) as e:
+        print("Error: %s" % e, file=sys.stderr)
+        return 2
+
+    common = [name for name in current if name in baseline]
+    if not common:
+        print("Error: no case of %s appears in %s" % (args.current, args.baseline),
+              file=sys.stderr)
+        return 2
+
+    regressions = 0
+    print("> %-24s %12s %12s %8s %10s" % ("case", "base ms", "now ms", "change", "p"))
+    for name in common:
+        base = baseline[name]["samples"]
+        now = current[name]["samples"]
+        m0 = statistics.median(base)
+        m1 = statistics.median(now)
+        change = (m1 - m0) / m0 if m0 > 0 else 0.0
+        p = mann_whitney_greater(base, now)
+        regressed = (p < args.alpha and change > args.threshold and
+                     m1 - m0 > args.min_delta_ms)
+        regressions += regressed
+        print("  %-24s %12.4f %12.4f %+7.1f%% %10.2g%s" %
+              (name, m0, m1, 100 * change, p, "  REGRESSION" if regressed else ""))
+
+    skipped = [name for name in current if name not in baseline]
+    if skipped:
+        print("> %d case(s) without a baseline, not compared (e.g. %s)" % (len(skipped), skipped[0]))
+
+    if regressions:
+        print("*** %d of %d cases regressed" % (regressions, len(common)))
+        return 1
+    print("*** No regressions in %d cases" % len(common))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
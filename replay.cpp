@@ -0,0 +1,298 @@
+/*
+ * Replays a driver trace recorded with VADD_TRACE=<file> (cuda_trace.h).
+ *
+ *   replay <trace>           re-execute the calls on the current backend
+ *   replay --model <trace>   predict the run time with a latency model
+ *
+ * Re-execution allocates the same buffers, issues the same copies, stream
+ * operations and launches in the recorded order, and compares the time per
+ * kind of call with the recording. With VADD_BACKEND=cpu it runs on the CPU
+ * backend, so a pipeline change can be checked on machines without a GPU.
+ * Buffer contents are not recorded; host data comes from scratch memory,
+ * pinned where the original copy used pinned memory.
+ *
+ * The model replays nothing. Each stream is a queue with its own clock and
+ * every call costs a fixed latency plus its bytes over the bandwidth of the
+ * link it uses; a kernel moves one int per pointer argument per thread
+ * through device memory. Synchronous calls and stream synchronisation make
+ * the host wait for the stream. The result is the predicted wall time of
+ * the recorded sequence, independent of the machine replaying it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cuda.h>
+#include <chrono>
+#include <map>
+#include <vector>
+
+#include "cuda_helper.h"
+
+// --- latency model -------------------------------------------------------
+#define MODEL_CALL_US          5.0     // driver call / launch overhead
+#define MODEL_PINNED_GBS      12.0     // host <-> device, pinned
+#define MODEL_PAGEABLE_GBS     6.0     // host <-> device, pageable
+#define MODEL_PEER_GBS        20.0     // device <-> device
+#define MODEL_DEVICE_GBS     300.0     // kernel access to device memory
+
+struct OpTotals {
+    int    count;
+    double recordedMs;
+    double replayedMs;
+};
+
+// --- functions -----------------------------------------------------------
+double copyUs(const TraceRecord &rec, double gbs)
+{
+    return MODEL_CALL_US + rec.bytes / (gbs * 1e3);
+}
+
+double modelRun(const std::vector<TraceEntry> &entries, std::vector<OpTotals> &totals)
+{
+    std::map<int, double> streamClock;      // time the stream drains, us
+    double host = 0;
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const TraceRecord &rec = entries[i].rec;
+        double &stream = streamClock[rec.stream];
+        double start = host > stream ? host : stream;
+        double cost = 0;
+
+        switch (rec.op) {
+        case TRACE_HTOD:
+        case TRACE_DTOH:
+            // synchronous: the host waits for the copy
+            cost = copyUs(rec, (rec.flags & TRACE_PINNED) ? MODEL_PINNED_GBS : MODEL_PAGEABLE_GBS);
+            stream = host = start + cost;
+            break;
+        case TRACE_HTOD_ASYNC:
+        case TRACE_DTOH_ASYNC:
+            cost = copyUs(rec, (rec.flags & TRACE_PINNED) ? MODEL_PINNED_GBS : MODEL_PAGEABLE_GBS);
+            stream = start + cost;
+            host += MODEL_CALL_US;
+            break;
+        case TRACE_DTOD:
+            cost = copyUs(rec, MODEL_PEER_GBS);
+            stream = start + cost;
+            host += MODEL_CALL_US;
+            break;
+        case TRACE_LAUNCH: {
+            int pointers = 0;
+            for (size_t p = 0; p < entries[i].params.size(); ++p)
+                pointers += entries[i].params[p].kind != TRACE_PARAM_VALUE;
+            double bytes = (double)rec.grid * rec.block * pointers * sizeof(int);
+            cost = MODEL_CALL_US + bytes / (MODEL_DEVICE_GBS * 1e3);
+            stream = start + cost;
+            host += MODEL_CALL_US;
+            break;
+        }
+        case TRACE_STREAM_SYNC:
+            cost = start - host;
+            host = start;
+            break;
+        case TRACE_HOST_FUNC:
+            stream = start + MODEL_CALL_US;
+            host += MODEL_CALL_US;
+            cost = MODEL_CALL_US;
+            break;
+        default:
+            // allocation and stream management: host-side cost only
+            cost = MODEL_CALL_US;
+            host += cost;
+            break;
+        }
+        totals[rec.op].replayedMs += cost / 1e3;
+    }
+
+    for (std::map<int, double>::iterator it = streamClock.begin(); it != streamClock.end(); ++it)
+        if (it->second > host)
+            host = it->second;
+    return host / 1e3;
+}
+
+void noopHostFunc(void *)
+{
+}
+
+// Scratch host memory for copies whose host side was pageable.
+void *pageableScratch(std::vector<char> &scratch, uint64_t bytes)
+{
+    if (scratch.size() < bytes)
+        scratch.resize(bytes);
+    return scratch.data();
+}
+
+double replayRun(const std::vector<TraceEntry> &entries, std::vector<OpTotals> &totals)
+{
+    std::map<uint32_t, CUdeviceptr> buffers;
+    std::map<uint32_t, char*>       pinned;
+    std::map<uint32_t, CUfunction>  functions;
+    std::map<int, CUstream>         streams;
+    std::vector<char>               scratch;
+    streams[0] = 0;
+
+    startup_clock::time_point start = startup_clock::now();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const TraceRecord &rec = entries[i].rec;
+        if (rec.result != CUDA_SUCCESS)
+            continue;       // failed in the recording; nothing to redo
+
+        // streams created before the trace started appear on first use
+        if (!streams.count(rec.stream) && rec.op != TRACE_STREAM_CREATE)
+            checkCudaErrors( drv.cuStreamCreate(&streams[rec.stream], CU_STREAM_NON_BLOCKING) );
+        CUstream stream = streams[rec.stream];
+        CUdeviceptr dev = buffers[rec.id] + rec.offset;
+        void *host = NULL;
+        if (rec.op >= TRACE_HTOD && rec.op <= TRACE_DTOH_ASYNC)
+            host = (rec.flags & TRACE_PINNED) ? (void*)(pinned[rec.srcId] + rec.srcOffset)
+                                              : pageableScratch(scratch, rec.bytes);
+
+        startup_clock::time_point t0 = startup_clock::now();
+        switch (rec.op) {
+        case TRACE_ALLOC:
+            checkCudaErrors( drv.cuMemAlloc(&buffers[rec.id], rec.bytes) );
+            break;
+        case TRACE_FREE:
+            checkCudaErrors( drv.cuMemFree(buffers[rec.id]) );
+            buffers.erase(rec.id);
+            break;
+        case TRACE_ALLOC_HOST:
+            checkCudaErrors( drv.cuMemAllocHost((void**)&pinned[rec.id], rec.bytes) );
+            break;
+        case TRACE_FREE_HOST:
+            checkCudaErrors( drv.cuMemFreeHost(pinned[rec.id]) );
+            pinned.erase(rec.id);
+            break;
+        case TRACE_HTOD:
+            checkCudaErrors( drv.cuMemcpyHtoD(dev, host, rec.bytes) );
+            break;
+        case TRACE_DTOH:
+            checkCudaErrors( drv.cuMemcpyDtoH(host, dev, rec.bytes) );
+            break;
+        case TRACE_HTOD_ASYNC:
+            checkCudaErrors( drv.cuMemcpyHtoDAsync(dev, host, rec.bytes, stream) );
+            break;
+        case TRACE_DTOH_ASYNC:
+            checkCudaErrors( drv.cuMemcpyDtoHAsync(host, dev, rec.bytes, stream) );
+            break;
+        case TRACE_DTOD:
+            checkCudaErrors( drv.cuMemcpyPeerAsync(dev, context, buffers[rec.srcId] + rec.srcOffset,
+                                                   context, rec.bytes, stream) );
+            break;
+        case TRACE_FUNCTION:
+            checkCudaErrors( drv.cuModuleGetFunction(&functions[rec.id], module.get(),
+                                                     entries[i].name.c_str()) );
+            break;
+        case TRACE_LAUNCH: {
+            const std::vector<TraceParam> &params = entries[i].params;
+            if (!functions.count(rec.id) || params.empty()) {
+                printf("* Launch %zu: kernel arguments were not recorded, skipped\n", i);
+                break;
+            }
+            CUdeviceptr pointers[TRACE_MAX_PARAMS];
+            int values[TRACE_MAX_PARAMS];
+            void *args[TRACE_MAX_PARAMS];
+            for (size_t p = 0; p < params.size(); ++p) {
+                if (params[p].kind == TRACE_PARAM_BUFFER) {
+                    pointers[p] = buffers[params[p].id] + params[p].value;
+                    args[p] = &pointers[p];
+                } else if (params[p].kind == TRACE_PARAM_PINNED) {
+                    pointers[p] = (CUdeviceptr)(pinned[params[p].id] + params[p].value);
+                    args[p] = &pointers[p];
+                } else {
+                    values[p] = (int)params[p].value;
+                    args[p] = &values[p];
+                }
+            }
+            checkCudaErrors( drv.cuLaunchKernel(functions[rec.id], rec.grid, 1, 1, rec.block, 1, 1,
+                                                rec.shared, stream, args, 0) );
+            break;
+        }
+        case TRACE_STREAM_CREATE:
+            checkCudaErrors( drv.cuStreamCreateWithPriority(&streams[rec.stream], rec.flags,
+                                                            (int)(int64_t)rec.offset) );
+            break;
+        case TRACE_STREAM_DESTROY:
+            checkCudaErrors( drv.cuStreamDestroy(stream) );
+            streams.erase(rec.stream);
+            break;
+        case TRACE_STREAM_SYNC:
+            checkCudaErrors( drv.cuStreamSynchronize(stream) );
+            break;
+        case TRACE_HOST_FUNC:
+            // the recorded callback cannot be replayed; keep its place in the stream
+            checkCudaErrors( drv.cuLaunchHostFunc(stream, noopHostFunc, NULL) );
+            break;
+        }
+        totals[rec.op].replayedMs += elapsedMs(t0);
+    }
+    for (std::map<int, CUstream>::iterator it = streams.begin(); it != streams.end(); ++it)
+        checkCudaErrors( drv.cuStreamSynchronize(it->second) );
+    double wall = elapsedMs(start);
+
+    // whatever the recording left allocated
+    for (std::map<int, CUstream>::iterator it = streams.begin(); it != streams.end(); ++it)
+        if (it->second)
+            drv.cuStreamDestroy(it->second);
+    for (std::map<uint32_t, CUdeviceptr>::iterator it = buffers.begin(); it != buffers.end(); ++it)
+        drv.cuMemFree(it->second);
+    for (std::map<uint32_t, char*>::iterator it = pinned.begin(); it != pinned.end(); ++it)
+        drv.cuMemFreeHost(it->second);
+    return wall;
+}
+
+int main(int argc, char **argv)
+{
+    bool model = argc > 2 && strcmp(argv[1], "--model") == 0;
+    const char *path = argv[argc - 1];
+    if (argc < 2 || argc > 3 || (argc == 3 && !model)) {
+        fprintf(stderr, "usage: %s [--model] <trace>\n", argv[0]);
+        return -1;
+    }
+
+    std::vector<TraceEntry> entries;
+    if (!readTrace(path, &entries)) {
+        fprintf(stderr, "Error: %s is not a readable driver trace\n", path);
+        return -1;
+    }
+
+    std::vector<OpTotals> totals(TRACE_OPS);
+    memset(totals.data(), 0, sizeof(OpTotals) * TRACE_OPS);
+    double recorded = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const TraceRecord &rec = entries[i].rec;
+        totals[rec.op].count++;
+        totals[rec.op].recordedMs += rec.durationNs / 1e6;
+        if ((rec.startNs + rec.durationNs) / 1e6 > recorded)
+            recorded = (rec.startNs + rec.durationNs) / 1e6;
+    }
+    if (!entries.empty())
+        recorded -= entries[0].rec.startNs / 1e6;
+    printf("> %zu driver calls recorded over %.3f ms\n", entries.size(), recorded);
+
+    double replayed;
+    if (model) {
+        printf("# Predicting with the latency model...\n");
+        replayed = modelRun(entries, totals);
+    } else {
+        printf("- Initializing...\n");
+        initCUDA();
+        printf("# Replaying...\n");
+        replayed = replayRun(entries, totals);
+    }
+
+    printf("> %-16s %8s %14s %14s\n", "call", "count", "recorded ms", model ? "model ms" : "replayed ms");
+    for (int op = 0; op < TRACE_OPS; ++op) {
+        if (totals[op].count)
+            printf("  %-16s %8d %14.3f %14.3f\n", traceOpName(op), totals[op].count,
+                   totals[op].recordedMs, totals[op].replayedMs);
+    }
+    printf("*** %s %.3f ms, recorded %.3f ms\n", model ? "Predicted" : "Replayed", replayed, recorded);
+
+    if (!model) {
+        printf("- Finalizing...\n");
+        finalizeCUDA();
+    }
+    return 0;
+}
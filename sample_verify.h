@@ -0,0 +1,106 @@
+/*
+ * Sampled verification of c = a + b on the host, for vectors too large to
+ * check element by element.
+ *
+ * Every boundary given (the first and last element of each chunk and of
+ * each side of a split job, where off-by-one errors show up) is checked,
+ * plus `samples` positions drawn uniformly, with replacement, from a
+ * seeded splitmix64 stream so that a run can be repeated exactly. A sample
+ * at least as large as the vector checks every element instead.
+ *
+ * If a fraction p of the elements is wrong, k independent draws all miss
+ * with probability (1 - p)^k. With no mismatch among the draws, p is below
+ * 1 - (1 - confidence)^(1/k) at that confidence (about 3/k at 95%); with
+ * mismatches, their share of the draws estimates p.
+ */
+
+#ifndef SAMPLE_VERIFY_H
+#define SAMPLE_VERIFY_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#define SAMPLE_CONFIDENCE 0.95
+
+struct SampleReport {
+    long long boundaries;       // boundary positions checked
+    long long samples;          // random draws checked
+    long long mismatches;       // among both
+    long long sampleMismatches; // among the random draws
+    long long firstIndex;       // lowest mismatching position found, -1 if none
+    uint64_t  seed;
+    bool      exhaustive;       // every position checked, samples == n
+};
+
+// splitmix64: one 64-bit state, full period, good enough to place samples.
+inline uint64_t splitmix64(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Appends the first and last element of [begin, end) to boundaries.
+inline void addBoundary(std::vector<long long> *boundaries, long long begin, long long end)
+{
+    if (begin >= end)
+        return;
+    boundaries->push_back(begin);
+    boundaries->push_back(end - 1);
+}
+
+inline SampleReport verifySample(const int *a, const int *b, const int *c, long long n,
+                                 const std::vector<long long> &boundaries,
+                                 long long samples, uint64_t seed)
+{
+    SampleReport report = { 0, 0, 0, 0, -1, seed, samples >= n };
+    for (size_t i = 0; i < boundaries.size(); ++i) {
+        long long k = boundaries[i];
+        if (k < 0 || k >= n)
+            continue;
+        ++report.boundaries;
+        if (c[k] != a[k] + b[k]) {
+            ++report.mismatches;
+            if (report.firstIndex < 0 || k < report.firstIndex)
+                report.firstIndex = k;
+        }
+    }
+
+    uint64_t state = seed;
+    if (report.exhaustive)
+        samples = n;
+    for (long long s = 0; s < samples && n > 0; ++s) {
+        long long k = report.exhaustive ? s : (long long)(splitmix64(&state) % (uint64_t)n);
+        ++report.samples;
+        if (c[k] != a[k] + b[k]) {
+            ++report.mismatches;
+            ++report.sampleMismatches;
+            if (report.firstIndex < 0 || k < report.firstIndex)
+                report.firstIndex = k;
+        }
+    }
+    return report;
+}
+
+inline void printSampleReport(const SampleReport &r, long long n)
+{
+    printf("> Sampled verification (seed %llu): %lld boundaries and %lld of %lld positions\n",
+           (unsigned long long)r.seed, r.boundaries, r.samples, n);
+    if (r.mismatches)
+        printf("* %lld errors found, first at array position %lld\n", r.mismatches, r.firstIndex);
+    if (r.samples == 0 || r.exhaustive)
+        return;
+    if (r.sampleMismatches == 0) {
+        double bound = 1 - pow(1 - SAMPLE_CONFIDENCE, 1.0 / r.samples);
+        printf("  Error rate below %.4g%% at %.0f%% confidence (at most ~%.0f wrong elements)\n",
+               100 * bound, 100 * SAMPLE_CONFIDENCE, ceil(bound * n));
+    } else {
+        printf("  Estimated error rate %.4g%% (%lld of %lld samples)\n",
+               100.0 * r.sampleMismatches / r.samples, r.sampleMismatches, r.samples);
+    }
+}
+
+#endif // SAMPLE_VERIFY_H
@@ -0,0 +1,22 @@
+/*
+ * Layout of a sparse int vector, shared by the host code (sparse_vector.h),
+ * the device kernels (kernel.cu) and their host build (kernel_host.h).
+ *
+ * A vector of n elements with nnz stored entries is two arrays of nnz ints:
+ * index, strictly increasing in [0, n), and value. Elements not listed are
+ * zero. This is COO with one dimension, which is also the single row of a
+ * CSR matrix, so a CSR row slice can be passed as is.
+ *
+ * SumSparseSparse writes one output slot per input entry, na + nb slots in
+ * merge order. Where both inputs hold an index, the entry from a carries
+ * the sum and the one from b becomes a tombstone: index SPARSE_TOMBSTONE,
+ * value 0. compactSparse() drops the tombstones on the host.
+ */
+
+#ifndef SPARSE_FORMAT_H
+#define SPARSE_FORMAT_H
+
+#define SPARSE_TOMBSTONE (-1)
+#define SPARSE_ITEMS     8      // output slots merged by each SumSparseSparse thread
+
+#endif // SPARSE_FORMAT_H
@@ -0,0 +1,100 @@
+/*
+ * Sparse int vectors on the host (layout in sparse_format.h).
+ *
+ * toSparse() gathers the non-zero elements of a dense vector without a
+ * branch per element: every element is written to the next free slot and
+ * the slot only advances when it was non-zero, so the loop runs at the
+ * same speed whatever the pattern of zeros. scatterSparse() is its inverse
+ * for an output that already holds the dense part, which is how a sparse b
+ * is added to a dense a.
+ *
+ * mergePathSplit() is the merge path search: the k-th slot of the merge of
+ * two sorted index lists lies after exactly i entries of the first and
+ * k - i of the second, and i is found by binary search along that
+ * diagonal. Each SumSparseSparse thread starts its own run of slots from
+ * there, with no communication between threads.
+ */
+
+#ifndef SPARSE_VECTOR_H
+#define SPARSE_VECTOR_H
+
+#include <string.h>
+#include <vector>
+
+#include "sparse_format.h"
+
+struct SparseVector {
+    std::vector<int> index;
+    std::vector<int> value;
+    int              n;
+
+    SparseVector() : n(0) {}
+
+    int    nnz() const   { return (int)index.size(); }
+    size_t bytes() const { return (index.size() + value.size()) * sizeof(int); }
+};
+
+inline void toSparse(const int *v, int n, SparseVector *out)
+{
+    out->n = n;
+    out->index.resize(n);
+    out->value.resize(n);
+    int *__restrict__ index = out->index.data();
+    int *__restrict__ value = out->value.data();
+    int k = 0;
+    for (int i = 0; i < n; ++i) {
+        index[k] = i;
+        value[k] = v[i];
+        k += (v[i] != 0);
+    }
+    out->index.resize(k);
+    out->value.resize(k);
+}
+
+// c[index[k]] += value[k]; the indices are distinct, so no two writes meet.
+inline void scatterSparse(const int *index, const int *value, int nnz, int *c)
+{
+    for (int k = 0; k < nnz; ++k)
+        c[index[k]] += value[k];
+}
+
+// How many of the first `diag` slots of the merge of a[0..na) and
+// b[0..nb) come from a. Equal indices take a first.
+inline int mergePathSplit(const int *a, int na, const int *b, int nb, int diag)
+{
+    int lo = diag > nb ? diag - nb : 0;
+    int hi = diag < na ? diag : na;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (a[mid] <= b[diag - 1 - mid])
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// The m slots written by SumSparseSparse, without their tombstones.
+inline void compactSparse(const int *index, const int *value, int m, int n, SparseVector *out)
+{
+    out->n = n;
+    out->index.resize(m);
+    out->value.resize(m);
+    int k = 0;
+    for (int s = 0; s < m; ++s) {
+        out->index[k] = index[s];
+        out->value[k] = value[s];
+        k += (index[s] != SPARSE_TOMBSTONE);
+    }
+    out->index.resize(k);
+    out->value.resize(k);
+}
+
+// Dense form of v into out[0..v.n).
+inline void toDense(const SparseVector &v, int *out)
+{
+    memset(out, 0, sizeof(int) * v.n);
+    scatterSparse(v.index.data(), v.value.data(), v.nnz(), out);
+}
+
+#endif // SPARSE_VECTOR_H
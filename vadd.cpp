@@ -0,0 +1,265 @@
+/*
+ * libvadd - implementation of the C interface in vadd.h.
+ *
+ * Built from the same pieces as the examples (driver table, context
+ * creation, module load, Sum launch), but every failure is reported as a
+ * vadd_status instead of exiting.
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <cuda.h>
+#include <mutex>
+
+#include "cuda_driver.h"
+#include "cuda_metrics.h"
+#include "vadd.h"
+
+struct vadd_context {
+    CUdevice   device;
+    CUcontext  context;
+    CUmodule   module;
+    CUfunction function;
+    int        block_size;
+};
+
+struct vadd_buffer {
+    vadd_context *ctx;
+    CUdeviceptr   ptr;
+    size_t        count;
+};
+
+struct vadd_stream {
+    vadd_context *ctx;
+    CUstream      stream;
+};
+
+static std::once_flag driverOnce;
+
+static vadd_status toStatus(CUresult err)
+{
+    switch (err) {
+    case CUDA_SUCCESS:              return VADD_SUCCESS;
+    case CUDA_ERROR_INVALID_VALUE:  return VADD_ERROR_INVALID_VALUE;
+    case CUDA_ERROR_OUT_OF_MEMORY:  return VADD_ERROR_OUT_OF_MEMORY;
+    case CUDA_ERROR_NO_DEVICE:
+    case CUDA_ERROR_INVALID_DEVICE: return VADD_ERROR_NO_DEVICE;
+    default:                        return VADD_ERROR_DRIVER;
+    }
+}
+
+// The calling thread may not have used this context before.
+static CUresult makeCurrent(const vadd_context *ctx)
+{
+    return drv.cuCtxSetCurrent(ctx->context);
+}
+
+static CUstream streamOf(const vadd_stream *stream)
+{
+    return stream ? stream->stream : 0;
+}
+
+// --- library -------------------------------------------------------------
+int vadd_api_version(void)
+{
+    return VADD_API_VERSION;
+}
+
+const char *vadd_status_string(vadd_status status)
+{
+    switch (status) {
+    case VADD_SUCCESS:             return "success";
+    case VADD_ERROR_INVALID_VALUE: return "invalid value";
+    case VADD_ERROR_OUT_OF_MEMORY: return "out of memory";
+    case VADD_ERROR_NO_DEVICE:     return "no such device";
+    case VADD_ERROR_MODULE:        return "kernel module could not be loaded";
+    case VADD_ERROR_DRIVER:        return "driver error";
+    }
+    return "unknown status";
+}
+
+// --- contexts ------------------------------------------------------------
+vadd_status vadd_context_create(int device, const char *module_path, vadd_context **ctx)
+{
+    if (!ctx)
+        return VADD_ERROR_INVALID_VALUE;
+    *ctx = NULL;
+
+    std::call_once(driverOnce, [] {
+        driverQuiet = true;
+        loadCudaDriver();
+        startMetricsFromEnv();
+    });
+
+    CUresult err;
+    int deviceCount = 0;
+    if ((err = drv.cuInit(0)) != CUDA_SUCCESS ||
+        (err = drv.cuDeviceGetCount(&deviceCount)) != CUDA_SUCCESS)
+        return toStatus(err);
+    if (device < 0 || device >= deviceCount)
+        return VADD_ERROR_NO_DEVICE;
+
+    vadd_context *c = new vadd_context();
+    if ((err = drv.cuDeviceGet(&c->device, device)) != CUDA_SUCCESS ||
+        (err = drv.cuDeviceGetAttribute(&c->block_size, CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_X, c->device)) != CUDA_SUCCESS ||
+        (err = drv.cuCtxCreate(&c->context, 0, c->device)) != CUDA_SUCCESS) {
+        delete c;
+        return toStatus(err);
+    }
+
+    if (drv.cuModuleLoad(&c->module, module_path ? module_path : "kernel.ptx") != CUDA_SUCCESS) {
+        drv.cuCtxDestroy(c->context);
+        delete c;
+        return VADD_ERROR_MODULE;
+    }
+    if (drv.cuModuleGetFunction(&c->function, c->module, "Sum") != CUDA_SUCCESS) {
+        drv.cuModuleUnload(c->module);
+        drv.cuCtxDestroy(c->context);
+        delete c;
+        return VADD_ERROR_MODULE;
+    }
+
+    *ctx = c;
+    return VADD_SUCCESS;
+}
+
+void vadd_context_destroy(vadd_context *ctx)
+{
+    if (!ctx)
+        return;
+    makeCurrent(ctx);
+    metricsRelease();
+    drv.cuModuleUnload(ctx->module);
+    drv.cuCtxDestroy(ctx->context);
+    delete ctx;
+}
+
+const char *vadd_backend_name(const vadd_context *)
+{
+    return backend == BACKEND_CUDA ? "cuda" : "cpu";
+}
+
+// --- buffers -------------------------------------------------------------
+vadd_status vadd_buffer_alloc(vadd_context *ctx, size_t count, vadd_buffer **buf)
+{
+    if (!ctx || !buf || count == 0)
+        return VADD_ERROR_INVALID_VALUE;
+    *buf = NULL;
+
+    CUresult err = makeCurrent(ctx);
+    if (err != CUDA_SUCCESS)
+        return toStatus(err);
+
+    vadd_buffer *b = new vadd_buffer();
+    b->ctx = ctx;
+    b->count = count;
+    if ((err = drv.cuMemAlloc(&b->ptr, sizeof(int) * count)) != CUDA_SUCCESS) {
+        delete b;
+        return toStatus(err);
+    }
+    *buf = b;
+    return VADD_SUCCESS;
+}
+
+void vadd_buffer_free(vadd_buffer *buf)
+{
+    if (!buf)
+        return;
+    makeCurrent(buf->ctx);
+    drv.cuMemFree(buf->ptr);
+    delete buf;
+}
+
+size_t vadd_buffer_count(const vadd_buffer *buf)
+{
+    return buf ? buf->count : 0;
+}
+
+// --- streams -------------------------------------------------------------
+vadd_status vadd_stream_create(vadd_context *ctx, vadd_stream **stream)
+{
+    if (!ctx || !stream)
+        return VADD_ERROR_INVALID_VALUE;
+    *stream = NULL;
+
+    CUresult err = makeCurrent(ctx);
+    if (err != CUDA_SUCCESS)
+        return toStatus(err);
+
+    vadd_stream *s = new vadd_stream();
+    s->ctx = ctx;
+    if ((err = drv.cuStreamCreate(&s->stream, CU_STREAM_NON_BLOCKING)) != CUDA_SUCCESS) {
+        delete s;
+        return toStatus(err);
+    }
+    *stream = s;
+    return VADD_SUCCESS;
+}
+
+void vadd_stream_destroy(vadd_stream *stream)
+{
+    if (!stream)
+        return;
+    makeCurrent(stream->ctx);
+    drv.cuStreamDestroy(stream->stream);
+    delete stream;
+}
+
+// --- operations ----------------------------------------------------------
+vadd_status vadd_copy_to_device(vadd_context *ctx, vadd_stream *stream,
+                                vadd_buffer *dst, const int *src, size_t count)
+{
+    if (!ctx || !dst || !src || count > dst->count)
+        return VADD_ERROR_INVALID_VALUE;
+
+    CUresult err = makeCurrent(ctx);
+    if (err == CUDA_SUCCESS)
+        err = drv.cuMemcpyHtoDAsync(dst->ptr, src, sizeof(int) * count, streamOf(stream));
+    return toStatus(err);
+}
+
+vadd_status vadd_copy_to_host(vadd_context *ctx, vadd_stream *stream,
+                              int *dst, const vadd_buffer *src, size_t count)
+{
+    if (!ctx || !dst || !src || count > src->count)
+        return VADD_ERROR_INVALID_VALUE;
+
+    CUresult err = makeCurrent(ctx);
+    if (err == CUDA_SUCCESS)
+        err = drv.cuMemcpyDtoHAsync(dst, src->ptr, sizeof(int) * count, streamOf(stream));
+    return toStatus(err);
+}
+
+vadd_status vadd_add(vadd_context *ctx, vadd_stream *stream,
+                     const vadd_buffer *a, const vadd_buffer *b,
+                     vadd_buffer *c, size_t count)
+{
+    if (!ctx || !a || !b || !c || count == 0 || count > INT_MAX ||
+        count > a->count || count > b->count || count > c->count)
+        return VADD_ERROR_INVALID_VALUE;
+
+    CUresult err = makeCurrent(ctx);
+    if (err != CUDA_SUCCESS)
+        return toStatus(err);
+
+    CUdeviceptr d_a = a->ptr, d_b = b->ptr, d_c = c->ptr;
+    int n = (int)count;
+    void *args[] = { &d_a, &d_b, &d_c, &n };
+    unsigned grid = (unsigned)((count + ctx->block_size - 1) / ctx->block_size);
+    err = drv.cuLaunchKernel(ctx->function,
+                             grid, 1, 1,                    // Grid dim
+                             ctx->block_size, 1, 1,         // Threads dim
+                             0, streamOf(stream), args, 0);
+    return toStatus(err);
+}
+
+vadd_status vadd_sync(vadd_context *ctx, vadd_stream *stream)
+{
+    if (!ctx)
+        return VADD_ERROR_INVALID_VALUE;
+
+    CUresult err = makeCurrent(ctx);
+    if (err == CUDA_SUCCESS)
+        err = drv.cuStreamSynchronize(streamOf(stream));
+    return toStatus(err);
+}
@@ -0,0 +1,80 @@
+/*
+ * libvadd - in-process vector addition.
+ *
+ * A stable C interface over the driver set-up and kernel launch of the
+ * examples. All handles are opaque; every call returns a vadd_status and
+ * never terminates the process.
+ *
+ * Copies and additions are queued on a stream and complete in order. Host
+ * memory passed to vadd_copy_to_device() and vadd_copy_to_host() must stay
+ * valid until vadd_sync() returns for that stream. A NULL stream means the
+ * context's default stream.
+ */
+
+#ifndef VADD_H
+#define VADD_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define VADD_API __attribute__((visibility("default")))
+#else
+#define VADD_API
+#endif
+
+#define VADD_API_VERSION 1
+
+typedef struct vadd_context vadd_context;
+typedef struct vadd_buffer  vadd_buffer;
+typedef struct vadd_stream  vadd_stream;
+
+typedef enum vadd_status {
+    VADD_SUCCESS              = 0,
+    VADD_ERROR_INVALID_VALUE  = 1,
+    VADD_ERROR_OUT_OF_MEMORY  = 2,
+    VADD_ERROR_NO_DEVICE      = 3,
+    VADD_ERROR_MODULE         = 4,
+    VADD_ERROR_DRIVER         = 5
+} vadd_status;
+
+VADD_API int          vadd_api_version(void);
+VADD_API const char  *vadd_status_string(vadd_status status);
+
+// Create a context on the given device. module_path names the kernel PTX;
+// NULL means "kernel.ptx" in the working directory.
+VADD_API vadd_status  vadd_context_create(int device, const char *module_path,
+                                          vadd_context **ctx);
+VADD_API void         vadd_context_destroy(vadd_context *ctx);
+// "cuda" or "cpu", depending on which backend the library is running on.
+VADD_API const char  *vadd_backend_name(const vadd_context *ctx);
+
+// Device buffer of count ints.
+VADD_API vadd_status  vadd_buffer_alloc(vadd_context *ctx, size_t count,
+                                        vadd_buffer **buf);
+VADD_API void         vadd_buffer_free(vadd_buffer *buf);
+VADD_API size_t       vadd_buffer_count(const vadd_buffer *buf);
+
+VADD_API vadd_status  vadd_stream_create(vadd_context *ctx, vadd_stream **stream);
+VADD_API void         vadd_stream_destroy(vadd_stream *stream);
+
+VADD_API vadd_status  vadd_copy_to_device(vadd_context *ctx, vadd_stream *stream,
+                                          vadd_buffer *dst, const int *src,
+                                          size_t count);
+VADD_API vadd_status  vadd_copy_to_host(vadd_context *ctx, vadd_stream *stream,
+                                        int *dst, const vadd_buffer *src,
+                                        size_t count);
+// c[i] = a[i] + b[i] for the first count elements.
+VADD_API vadd_status  vadd_add(vadd_context *ctx, vadd_stream *stream,
+                               const vadd_buffer *a, const vadd_buffer *b,
+                               vadd_buffer *c, size_t count);
+VADD_API vadd_status  vadd_sync(vadd_context *ctx, vadd_stream *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VADD_H